@@ -15,108 +15,913 @@
 #include <iostream>
 #include <iterator>
 #include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <string>
+#include <compare>
+#include <cstdint>
+#include <string_view>
+#include <memory>
+#include <new>
+#include <vector>
+#include <utility>
+#include <tuple>
+#include <functional>
+#include <cmath>
+#include <type_traits>
 #include <array>//only used for comparison demo
+//bounds checks cost a branch per access and keep loops from vectorizing,
+//build with -DARRAY_CHECKED=0 to drop them
+#ifndef ARRAY_CHECKED
+#define ARRAY_CHECKED 1
+#endif
 using namespace std;
 
+[[noreturn]] inline void outOfRange(){
+    cerr<<"Index out range ";
+    exit(1);
+}
+
 template<class T,size_t Size>
 class Array{
     public:
     T arr[Size];
-    class iterator{
+    //a raw pointer underneath, so it models contiguous_iterator
+    template<class E>
+    class basic_iterator{
         public:
-        Array* parent;
         using difference_type =   ptrdiff_t;
-        using value_type =        T;
-        using pointer =           T*;
-        using reference =         T&;
+        using value_type =        remove_const_t<E>;
+        using element_type =      E;
+        using pointer =           E*;
+        using reference =         E&;
         using iterator_category = random_access_iterator_tag;
-        size_t pos;
-        iterator(Array*p):parent{p},pos{0}{}
-        iterator(Array*p,size_t i):parent{p},pos{i}{}
-        iterator operator+(size_t i){
-            if(i+pos<Size)
-            return iterator(parent,pos+i);
-            cerr<<"Index out range ";
-            exit(1);
-        }
-        iterator operator-(size_t i){
-            return iterator(parent,pos-i);
-        }
-        T& operator*(){
-            if(pos<Size)
-            return *(parent->arr+pos);
-            cerr<<"Index out range ";
-            exit(1);
-        }
-        iterator& operator++(){
-            pos++;
+        using iterator_concept =  contiguous_iterator_tag;
+        E* ptr=nullptr;
+#if ARRAY_CHECKED
+        E* first=nullptr;
+        E* last=nullptr;
+        constexpr basic_iterator(E*p,E*f,E*l):ptr{p},first{f},last{l}{}
+        template<class F> requires is_convertible_v<F*,E*>
+        constexpr basic_iterator(const basic_iterator<F>& other):ptr{other.ptr},first{other.first},last{other.last}{}
+#else
+        constexpr basic_iterator(E*p,E*,E*):ptr{p}{}
+        template<class F> requires is_convertible_v<F*,E*>
+        constexpr basic_iterator(const basic_iterator<F>& other):ptr{other.ptr}{}
+#endif
+        constexpr basic_iterator()=default;
+        constexpr E& operator*()const{
+#if ARRAY_CHECKED
+            if(ptr<first||ptr>=last) outOfRange();
+#endif
+            return *ptr;
+        }
+        constexpr E* operator->()const{return ptr;}
+        constexpr E& operator[](difference_type i)const{return *(*this+i);}
+        constexpr basic_iterator& operator+=(difference_type i){
+#if ARRAY_CHECKED
+            if(ptr+i<first||ptr+i>last) outOfRange();
+#endif
+            ptr+=i;
+            return *this;
+        }
+        constexpr basic_iterator& operator-=(difference_type i){return *this+=-i;}
+        constexpr basic_iterator operator+(difference_type i)const{
+            basic_iterator temp(*this);
+            return temp+=i;
+        }
+        friend constexpr basic_iterator operator+(difference_type i,const basic_iterator& it){return it+i;}
+        constexpr basic_iterator operator-(difference_type i)const{
+            basic_iterator temp(*this);
+            return temp-=i;
+        }
+        constexpr difference_type operator-(const basic_iterator& other)const{
+            return ptr-other.ptr;
+        }
+        constexpr basic_iterator& operator++(){
+            ptr++;
             return *this;
         }
-        iterator operator++(int){
-            iterator temp(*this);
+        constexpr basic_iterator operator++(int){
+            basic_iterator temp(*this);
             operator++();
             return temp;
         }
-        iterator& operator--(){
-            pos--;
+        constexpr basic_iterator& operator--(){
+            ptr--;
             return *this;
         }
-        iterator operator--(int){
-            iterator temp(*this);
+        constexpr basic_iterator operator--(int){
+            basic_iterator temp(*this);
             operator--();
             return temp;
         }
-        bool operator!=(iterator other){
-            return pos!=other.pos;
+        constexpr bool operator==(const basic_iterator& other)const{
+            return ptr==other.ptr;
         }
-        bool operator==(iterator other){
-            return pos==other.pos;
+        constexpr strong_ordering operator<=>(const basic_iterator& other)const{
+            return ptr<=>other.ptr;
         }
-        bool operator<(iterator other){
-            return pos<other.pos;
+    };
+    using iterator=basic_iterator<T>;
+    using const_iterator=basic_iterator<const T>;
+    using value_type=T;
+    //value initialized, so nested Arrays and constant expressions never see
+    //indeterminate elements
+    constexpr Array():arr{}{}
+    //elements past the end of a shorter source are value initialized, a
+    //longer source is an error (or truncated in unchecked builds), use
+    //SmallArray when the size is only known at run time
+    template <class iterator>
+    constexpr Array(iterator i, iterator j){
+        size_t n=size_t(distance(i,j));
+#if ARRAY_CHECKED
+        if(n>Size) outOfRange();
+#endif
+        std::fill(copy_n(i,min(n,Size),arr),arr+Size,T{});
+    }
+    constexpr Array(initializer_list<T>lst):Array(lst.begin(),lst.end()){}
+    //element-wise expressions are evaluated here, in one pass, no temporaries
+    template <class E> requires requires{typename E::array_expression;}
+    constexpr Array(const E& e){assign(e);}
+    template <class E> requires requires{typename E::array_expression;}
+    constexpr Array& operator=(const E& e){
+        assign(e);
+        return *this;
+    }
+    constexpr iterator begin(){return iterator(arr,arr,arr+Size);}
+    constexpr iterator end(){return iterator(arr+Size,arr,arr+Size);}
+    constexpr const_iterator begin()const{return const_iterator(arr,arr,arr+Size);}
+    constexpr const_iterator end()const{return const_iterator(arr+Size,arr,arr+Size);}
+    constexpr T* data(){return arr;}
+    constexpr const T* data()const{return arr;}
+    static constexpr size_t size(){return Size;}
+    constexpr T& operator[](size_t index){
+#if ARRAY_CHECKED
+        if(index>=Size) outOfRange();
+#endif
+        return arr[index];
+    }
+    constexpr const T& operator[](size_t index)const{
+#if ARRAY_CHECKED
+        if(index>=Size) outOfRange();
+#endif
+        return arr[index];
+    }
+    constexpr iterator operator+(size_t index){
+#if ARRAY_CHECKED
+        if(index>=Size) outOfRange();
+#endif
+        return begin()+ptrdiff_t(index);
+    }
+    constexpr T& operator*(){
+        return arr[0];
+    }
+    constexpr void fill(const T& value){
+        std::fill(arr,arr+Size,value);
+    }
+    constexpr bool operator==(const Array& other)const{
+        return equal(arr,arr+Size,other.arr);
+    }
+    private:
+    template <class E>
+    constexpr void assign(const E& e){
+        static_assert(E::size()==Size,"expression size does not match");
+        if constexpr(Size<=16){
+            //fully unrolled, the SLP vectorizer packs it into SSE/AVX lanes
+            [&]<size_t... I>(index_sequence<I...>){
+                ((arr[I]=e[I]),...);
+            }(make_index_sequence<Size>{});
+        }else{
+            for(size_t i=0;i<Size;i++) arr[i]=e[i];
         }
-        bool operator<=(iterator other){
-            return pos<=other.pos;
+    }
+};
+
+static_assert(contiguous_iterator<Array<int,4>::iterator>);
+static_assert(contiguous_iterator<Array<int,4>::const_iterator>);
+
+//SmallArray keeps up to N elements inline, aligned to Align, and moves
+//them to one heap block only when it grows past N
+template<class T,size_t N,size_t Align=alignof(T)>
+class SmallArray{
+    static_assert(N>0,"use std::vector when nothing fits inline");
+    static_assert(Align>=alignof(T)&&(Align&(Align-1))==0,"bad alignment");
+    public:
+    using value_type=T;
+    using iterator=T*;
+    using const_iterator=const T*;
+    SmallArray(){}
+    SmallArray(initializer_list<T>lst){append(lst.begin(),lst.end());}
+    template <class iterator>
+    SmallArray(iterator i, iterator j){append(i,j);}
+    SmallArray(const SmallArray& other){append(other.begin(),other.end());}
+    SmallArray(SmallArray&& other)noexcept(is_nothrow_move_constructible_v<T>){
+        steal(other);
+    }
+    SmallArray& operator=(const SmallArray& other){
+        if(this!=&other){
+            clear();
+            append(other.begin(),other.end());
         }
-        bool operator>(iterator other){
-            return pos>other.pos;
+        return *this;
+    }
+    SmallArray& operator=(SmallArray&& other)noexcept(is_nothrow_move_constructible_v<T>){
+        if(this!=&other){
+            clear();
+            release();
+            steal(other);
         }
-        bool operator>=(iterator other){
-            return pos>=other.pos;
+        return *this;
+    }
+    ~SmallArray(){
+        clear();
+        release();
+    }
+    template<class... Args>
+    T& emplace_back(Args&&... args){
+        if(count<cap){
+            T* slot=new(ptr+count) T(forward<Args>(args)...);
+            count++;
+            return *slot;
+        }
+        //build the new element first, args may refer to an old one
+        size_t newCap=cap*2;
+        Block fresh=allocate(newCap);
+        T* slot=new(fresh.get()+count) T(forward<Args>(args)...);
+        try{
+            relocate(fresh,newCap);
+        }catch(...){
+            slot->~T();
+            throw;
         }
+        count++;
+        return *slot;
+    }
+    void push_back(const T& value){emplace_back(value);}
+    void push_back(T&& value){emplace_back(move(value));}
+    void pop_back(){
+        ptr[--count].~T();
+    }
+    void clear(){
+        destroy_n(ptr,count);
+        count=0;
+    }
+    void reserve(size_t n){
+        if(n<=cap) return;
+        Block fresh=allocate(n);
+        relocate(fresh,n);
+    }
+    void resize(size_t n){
+        reserve(n);
+        while(count>n) pop_back();
+        for(;count<n;count++) new(ptr+count) T();
+    }
+    T* data(){return ptr;}
+    const T* data()const{return ptr;}
+    size_t size()const{return count;}
+    size_t capacity()const{return cap;}
+    bool empty()const{return count==0;}
+    bool isInline()const{return ptr==inlineData();}
+    static constexpr size_t inlineCapacity(){return N;}
+    iterator begin(){return ptr;}
+    iterator end(){return ptr+count;}
+    const_iterator begin()const{return ptr;}
+    const_iterator end()const{return ptr+count;}
+    T& operator[](size_t index){
+#if ARRAY_CHECKED
+        if(index>=count) outOfRange();
+#endif
+        return ptr[index];
+    }
+    const T& operator[](size_t index)const{
+#if ARRAY_CHECKED
+        if(index>=count) outOfRange();
+#endif
+        return ptr[index];
+    }
+    private:
+    alignas(Align) unsigned char buffer[N*sizeof(T)];
+    T* ptr=inlineData();
+    size_t count=0;
+    size_t cap=N;
+    T* inlineData(){return reinterpret_cast<T*>(buffer);}
+    const T* inlineData()const{return reinterpret_cast<const T*>(buffer);}
+    struct Deallocate{
+        void operator()(T* p)const{::operator delete(p,align_val_t{Align});}
     };
-    Array(){};
+    //owns a heap block until relocate() adopts it, so a throwing T frees it
+    using Block=unique_ptr<T,Deallocate>;
+    static Block allocate(size_t n){
+        return Block(static_cast<T*>(::operator new(n*sizeof(T),align_val_t{Align})));
+    }
+    void release(){
+        if(!isInline()) Deallocate{}(ptr);
+        ptr=inlineData();
+        cap=N;
+    }
+    //moves the elements into fresh storage of capacity n and adopts it
+    void relocate(Block& fresh,size_t n){
+        uninitialized_move_n(ptr,count,fresh.get());
+        destroy_n(ptr,count);
+        if(!isInline()) Deallocate{}(ptr);
+        ptr=fresh.release();
+        cap=n;
+    }
+    void steal(SmallArray& other){
+        if(other.isInline()){
+            uninitialized_move_n(other.ptr,other.count,ptr);
+            count=other.count;
+            other.clear();
+            return;
+        }
+        ptr=other.ptr;
+        count=other.count;
+        cap=other.cap;
+        other.ptr=other.inlineData();
+        other.count=0;
+        other.cap=N;
+    }
     template <class iterator>
-    Array(iterator i, iterator j){
-        if(size_t(distance(i,j))<=Size)
-        copy(i,j,arr);
+    void append(iterator i, iterator j){
+        if constexpr(is_base_of_v<forward_iterator_tag,typename iterator_traits<iterator>::iterator_category>)
+            reserve(count+size_t(distance(i,j)));
+        for(;i!=j;++i) emplace_back(*i);
+    }
+};
+
+//Expression templates: arithmetic on Arrays of numbers builds a tree of
+//small nodes, and only assigning it to an Array runs a loop
+template<class E>
+concept ArrayNode=requires{typename remove_cvref_t<E>::array_expression;};
+
+template<class E>
+struct IsNumericArray:false_type{};
+template<class T,size_t N>
+struct IsNumericArray<Array<T,N>>:bool_constant<is_arithmetic_v<T>>{};
+
+template<class E>
+concept ArrayExpression=ArrayNode<E>||IsNumericArray<remove_cvref_t<E>>::value;
+
+//Arrays are held by reference, nodes are tiny and held by value
+template<class E>
+using ExprOperand=conditional_t<ArrayNode<E>,E,const E&>;
+
+template<class E>
+constexpr auto elementOf(const E& e,size_t i){
+    if constexpr(ArrayNode<E>) return e[i];
+    else return e.arr[i];//no bounds check inside a loop of known size
+}
+
+template<class T,size_t N>
+struct ScalarExpr{
+    using array_expression=void;
+    using value_type=T;
+    T value;
+    static constexpr size_t size(){return N;}
+    constexpr T operator[](size_t)const{return value;}
+};
+
+template<class Op,class... E>
+struct ElementwiseExpr{
+    using array_expression=void;
+    using value_type=decltype(Op{}(declval<typename E::value_type>()...));
+    static constexpr size_t N=(E::size(),...);
+    static_assert(((E::size()==N)&&...),"element-wise operands differ in size");
+    tuple<ExprOperand<E>...> operands;
+    static constexpr size_t size(){return N;}
+    constexpr value_type operator[](size_t i)const{
+        return apply([i](const auto&... e){return Op{}(elementOf(e,i)...);},operands);
     }
-    Array(initializer_list<T>lst){
-        if(lst.size()<=Size)
-        copy(lst.begin(),lst.end(),arr);
+};
+
+struct FusedMultiplyAdd{
+    template<class T>
+    constexpr T operator()(T a,T b,T c)const{
+#ifdef __FMA__
+        if constexpr(is_floating_point_v<T>)
+            if(!is_constant_evaluated()) return std::fma(a,b,c);
+#endif
+        return a*b+c;
     }
-    iterator begin(){return iterator(this);}
-    iterator end(){return iterator(this, Size);}
-    T& operator[](size_t index){
-        if(index>=Size){
-            cerr<<"Index out range ";
-            exit(1);
+};
+
+template<class Op,class... E>
+constexpr auto makeExpr(const E&... e){
+    return ElementwiseExpr<Op,E...>{{e...}};
+}
+
+template<ArrayExpression E,class S>
+constexpr auto splat(S s){
+    return ScalarExpr<typename E::value_type,E::size()>{typename E::value_type(s)};
+}
+
+template<ArrayExpression L,ArrayExpression R>
+constexpr auto operator+(const L& l,const R& r){return makeExpr<plus<>>(l,r);}
+template<ArrayExpression L,ArrayExpression R>
+constexpr auto operator-(const L& l,const R& r){return makeExpr<minus<>>(l,r);}
+template<ArrayExpression L,ArrayExpression R>
+constexpr auto operator*(const L& l,const R& r){return makeExpr<multiplies<>>(l,r);}
+template<ArrayExpression L,ArrayExpression R>
+constexpr auto operator/(const L& l,const R& r){return makeExpr<divides<>>(l,r);}
+template<ArrayExpression E>
+constexpr auto operator-(const E& e){return makeExpr<negate<>>(e);}
+//scalars only scale: Array+n already means an iterator n elements in
+template<ArrayExpression E,class S> requires is_arithmetic_v<S>
+constexpr auto operator*(const E& e,S s){return e*splat<E>(s);}
+template<ArrayExpression E,class S> requires is_arithmetic_v<S>
+constexpr auto operator*(S s,const E& e){return splat<E>(s)*e;}
+template<ArrayExpression E,class S> requires is_arithmetic_v<S>
+constexpr auto operator/(const E& e,S s){return e/splat<E>(s);}
+template<ArrayExpression A,ArrayExpression B,ArrayExpression C>
+constexpr auto fma(const A& a,const B& b,const C& c){return makeExpr<FusedMultiplyAdd>(a,b,c);}
+template<ArrayExpression A,class S,ArrayExpression C> requires is_arithmetic_v<S>
+constexpr auto fma(const A& a,S s,const C& c){return fma(a,splat<A>(s),c);}
+
+//Reductions keep one accumulator per vector lane so the compiler can use
+//packed instructions; floating point results may differ from a strictly
+//left to right loop in the last bits. The lanes have the type Acc, so
+//narrow elements can be combined in a wider type
+template<class Acc,ArrayExpression E,class Op>
+constexpr Acc reduceLanes(const E& e,Op op){
+    constexpr size_t N=E::size();
+    constexpr size_t Lanes=min(N,max(size_t(1),size_t(32)/sizeof(Acc)));
+    Acc acc[Lanes];
+    for(size_t l=0;l<Lanes;l++) acc[l]=Acc(elementOf(e,l));
+    size_t i=Lanes;
+    for(;i+Lanes<=N;i+=Lanes)
+        for(size_t l=0;l<Lanes;l++) acc[l]=op(acc[l],elementOf(e,i+l));
+    for(;i<N;i++) acc[0]=op(acc[0],elementOf(e,i));
+    Acc result=acc[0];
+    for(size_t l=1;l<Lanes;l++) result=op(result,acc[l]);
+    return result;
+}
+//accumulates in the element type, fine for min and max
+template<ArrayExpression E,class Op>
+constexpr auto reduce(const E& e,Op op){
+    return reduceLanes<typename E::value_type>(e,op);
+}
+//accumulates in the type of init, like std::reduce
+template<ArrayExpression E,class Acc,class Op>
+constexpr Acc reduce(const E& e,Acc init,Op op){
+    return op(init,reduceLanes<Acc>(e,op));
+}
+//sums in the promoted element type (int for uint8_t or int16_t), the same
+//as std::accumulate with an int init; pass init for a wider one
+template<ArrayExpression E>
+constexpr auto sum(const E& e){
+    using T=typename E::value_type;
+    return reduce(e,decltype(T{}+T{}){},plus<>{});
+}
+template<ArrayExpression E,class Acc>
+constexpr Acc sum(const E& e,Acc init){return reduce(e,init,plus<>{});}
+template<ArrayExpression L,ArrayExpression R>
+constexpr auto dot(const L& l,const R& r){return sum(l*r);}
+template<ArrayExpression E>
+constexpr auto min(const E& e){
+    return reduce(e,[](auto a,auto b){return b<a?b:a;});
+}
+template<ArrayExpression E>
+constexpr auto max(const E& e){
+    return reduce(e,[](auto a,auto b){return a<b?b:a;});
+}
+template<ArrayExpression E>
+auto norm(const E& e){return std::sqrt(dot(e,e));}
+
+static_assert(Array<int,4>(Array<int,4>{1,2,3,4}*2-Array<int,4>{1,1,1,1})==Array<int,4>{1,3,5,7});
+static_assert(dot(Array<int,3>{1,2,3},Array<int,3>{4,5,6})==32);
+static_assert(min(Array<int,5>{4,2,8,1,9})==1&&max(Array<int,5>{4,2,8,1,9})==9);
+static_assert(sum(Array<uint8_t,4>{200,200,200,200})==800);
+static_assert(sum(Array<int,2>{2000000000,2000000000},int64_t(0))==4000000000);
+
+//Structure of arrays: SoA<S,Size,&S::a,&S::b,...> stores each listed
+//field of S in its own Array, so a loop over one field reads contiguous
+//memory, while operator[] still gives a row that reads and writes like S
+template<class M>
+struct MemberOf;
+template<class S,class T>
+struct MemberOf<T S::*>{
+    using owner=S;
+    using type=T;
+};
+
+template<auto A,auto B>
+constexpr bool sameField(){
+    if constexpr(is_same_v<decltype(A),decltype(B)>) return A==B;
+    else return false;
+}
+
+template<class S,size_t Size,auto... Fields>
+class SoA{
+    static_assert(sizeof...(Fields)>0,"list at least one field");
+    static_assert((is_same_v<typename MemberOf<decltype(Fields)>::owner,S>&&...),
+                  "every field must be a data member of S");
+    template<auto F>
+    static constexpr size_t indexOf(){
+        size_t index=0,found=sizeof...(Fields);
+        ((sameField<F,Fields>()?found=index:0,index++),...);
+        return found;
+    }
+    public:
+    tuple<Array<typename MemberOf<decltype(Fields)>::type,Size>...> columns;
+    class Row{
+        public:
+        constexpr Row(SoA* s,size_t i):soa{s},index{i}{}
+        template<auto F>
+        constexpr auto& get()const{return soa->template column<F>().arr[index];}
+        constexpr operator S()const{return soa->load(index);}
+        constexpr Row& operator=(const S& value){
+            soa->store(index,value);
+            return *this;
         }
-        return arr[index];
+        private:
+        SoA* soa;
+        size_t index;
+    };
+    static constexpr size_t size(){return Size;}
+    template<auto F>
+    constexpr auto& column(){
+        static_assert(indexOf<F>()<sizeof...(Fields),"field is not part of this SoA");
+        return get<indexOf<F>()>(columns);
+    }
+    template<auto F>
+    constexpr const auto& column()const{
+        static_assert(indexOf<F>()<sizeof...(Fields),"field is not part of this SoA");
+        return get<indexOf<F>()>(columns);
+    }
+    constexpr Row operator[](size_t index){
+#if ARRAY_CHECKED
+        if(index>=Size) outOfRange();
+#endif
+        return Row(this,index);
+    }
+    //fields of S that are not listed come back value initialized
+    constexpr S load(size_t index)const{
+        S value{};
+        ((value.*Fields=column<Fields>()[index]),...);
+        return value;
+    }
+    constexpr void store(size_t index,const S& value){
+        ((column<Fields>()[index]=value.*Fields),...);
     }
-    iterator operator+(size_t index){
-        if(index>=Size){
-            cerr<<"Index out range ";
-            exit(1);
+};
+
+//N-dimensional extension: MdArray keeps every element in one row-major
+//Array, MdView looks at any part of it through extents and strides, so
+//slices, sub-blocks and transposes never copy
+template<class T,size_t Rank>
+class MdView{
+    public:
+    T* ptr=nullptr;
+    Array<size_t,Rank> extents{};
+    Array<size_t,Rank> strides{};
+    constexpr MdView()=default;
+    constexpr MdView(T* p,Array<size_t,Rank> e,Array<size_t,Rank> s)
+        :ptr{p},extents{e},strides{s}{}
+    template<class U> requires(!is_same_v<U,T>&&is_convertible_v<U*,T*>)
+    constexpr MdView(const MdView<U,Rank>& other)
+        :ptr{other.ptr},extents{other.extents},strides{other.strides}{}
+    static constexpr size_t rank(){return Rank;}
+    constexpr size_t extent(size_t dim)const{return extents[dim];}
+    constexpr size_t stride(size_t dim)const{return strides[dim];}
+    constexpr size_t size()const{
+        size_t n=1;
+        for(size_t e:extents) n*=e;
+        return n;
+    }
+    template<class... I> requires(sizeof...(I)==Rank)
+    constexpr T& operator()(I... indices)const{
+        const size_t index[]={size_t(indices)...};
+        size_t offset=0;
+        for(size_t d=0;d<Rank;d++){
+#if ARRAY_CHECKED
+            if(index[d]>=extents[d]) outOfRange();
+#endif
+            offset+=index[d]*strides[d];
         }
-        return iterator(this,index);
+        return ptr[offset];
     }
-    T& operator*(){
-        return arr[0];
+    //fixes one index, dropping that dimension
+    constexpr MdView<T,Rank-1> slice(size_t dim,size_t index)const requires(Rank>1){
+#if ARRAY_CHECKED
+        if(index>=extents[dim]) outOfRange();
+#endif
+        MdView<T,Rank-1> v;
+        v.ptr=ptr+index*strides[dim];
+        for(size_t d=0,k=0;d<Rank;d++){
+            if(d==dim) continue;
+            v.extents[k]=extents[d];
+            v.strides[k++]=strides[d];
+        }
+        return v;
+    }
+    //keeps count indices of one dimension starting at first
+    constexpr MdView sub(size_t dim,size_t first,size_t count)const{
+#if ARRAY_CHECKED
+        if(first+count>extents[dim]) outOfRange();
+#endif
+        MdView v=*this;
+        v.ptr=ptr+first*strides[dim];
+        v.extents[dim]=count;
+        return v;
+    }
+    constexpr MdView transpose(size_t a=0,size_t b=1)const{
+        MdView v=*this;
+        swap(v.extents[a],v.extents[b]);
+        swap(v.strides[a],v.strides[b]);
+        return v;
+    }
+    constexpr bool contiguous()const{
+        size_t expected=1;
+        for(size_t d=Rank;d-->0;){
+            if(extents[d]!=1&&strides[d]!=expected) return false;
+            expected*=extents[d];
+        }
+        return true;
+    }
+};
+
+template<class T,size_t... Extents>
+class MdArray{
+    public:
+    static constexpr size_t Rank=sizeof...(Extents);
+    static constexpr Array<size_t,Rank> extents{Extents...};
+    Array<T,(Extents*...)> data;
+    constexpr MdArray(){};
+    constexpr MdArray(initializer_list<T>lst):data(lst){}
+    static constexpr Array<size_t,Rank> strides(){
+        Array<size_t,Rank> s;
+        size_t stride=1;
+        for(size_t d=Rank;d-->0;){
+            s[d]=stride;
+            stride*=extents[d];
+        }
+        return s;
+    }
+    template<class... I> requires(sizeof...(I)==Rank)
+    constexpr T& operator()(I... indices){return view()(indices...);}
+    template<class... I> requires(sizeof...(I)==Rank)
+    constexpr const T& operator()(I... indices)const{return view()(indices...);}
+    constexpr MdView<T,Rank> view(){return {data.data(),extents,strides()};}
+    constexpr MdView<const T,Rank> view()const{return {data.data(),extents,strides()};}
+    constexpr auto begin(){return data.begin();}
+    constexpr auto end(){return data.end();}
+    constexpr auto begin()const{return data.begin();}
+    constexpr auto end()const{return data.end();}
+};
+
+//calls f on every rows x cols tile of a matrix view, edge tiles are smaller
+template<class T,class F>
+constexpr void forEachTile(MdView<T,2> m,size_t rows,size_t cols,F f){
+    for(size_t i=0;i<m.extent(0);i+=rows)
+        for(size_t j=0;j<m.extent(1);j+=cols)
+            f(m.sub(0,i,min(rows,m.extent(0)-i)).sub(1,j,min(cols,m.extent(1)-j)),i,j);
+}
+
+//c+=a*b one tile at a time so the working set stays in cache
+template<class T>
+void multiplyBlocked(MdView<const T,2> a,MdView<const T,2> b,MdView<T,2> c,size_t tile=32){
+    forEachTile(c,tile,tile,[&](MdView<T,2> ct,size_t i0,size_t j0){
+        for(size_t k0=0;k0<a.extent(1);k0+=tile){
+            size_t kn=min(tile,a.extent(1)-k0);
+            auto at=a.sub(0,i0,ct.extent(0)).sub(1,k0,kn);
+            auto bt=b.sub(0,k0,kn).sub(1,j0,ct.extent(1));
+            for(size_t i=0;i<ct.extent(0);i++)
+                for(size_t k=0;k<kn;k++){
+                    T aik=at(i,k);
+                    for(size_t j=0;j<ct.extent(1);j++)
+                        ct(i,j)+=aik*bt(k,j);
+                }
+        }
+    });
+}
+
+static_assert(MdArray<int,2,3>{1,2,3,4,5,6}(1,2)==6);
+static_assert(MdArray<int,2,3>{1,2,3,4,5,6}.view().transpose()(2,1)==6);
+static_assert(!MdArray<int,2,3>{}.view().transpose().contiguous());
+
+template<class View>
+void printMatrix(const View& m){
+    for(size_t i=0;i<m.extent(0);i++){
+        for(size_t j=0;j<m.extent(1);j++)
+            cout<<m(i,j)<<" ";
+        cout<<endl;
+    }
+}
+
+//lookup tables computed by the compiler, they land in .rodata with no
+//static initialisation at startup
+constexpr Array<uint32_t,256> makeCrc32Table(){
+    Array<uint32_t,256> table;
+    for(uint32_t i=0;i<256;i++){
+        uint32_t c=i;
+        for(int k=0;k<8;k++)
+            c=c&1?0xEDB88320u^(c>>1):c>>1;
+        table[i]=c;
+    }
+    return table;
+}
+constexpr auto crc32Table=makeCrc32Table();
+
+constexpr uint32_t crc32(string_view bytes){
+    uint32_t c=0xFFFFFFFFu;
+    for(unsigned char b:bytes)
+        c=crc32Table[(c^b)&0xFF]^(c>>8);
+    return c^0xFFFFFFFFu;
+}
+static_assert(crc32("123456789")==0xCBF43926u);
+
+//length of a UTF-8 sequence from its lead byte, 0 for invalid leads
+constexpr Array<uint8_t,256> makeUtf8LengthTable(){
+    Array<uint8_t,256> table;
+    for(size_t b=0;b<256;b++)
+        table[b]=b<0x80?1:b<0xC2?0:b<0xE0?2:b<0xF0?3:b<0xF5?4:0;
+    return table;
+}
+constexpr auto utf8Length=makeUtf8LengthTable();
+static_assert(utf8Length[0xE2]==3&&utf8Length[0x80]==0);
+
+//sine over a quarter turn by Taylor series, std::sin is not constexpr
+template<size_t N>
+constexpr Array<double,N> makeSineTable(){
+    constexpr double halfPi=1.57079632679489661923;
+    Array<double,N> table;
+    for(size_t i=0;i<N;i++){
+        double x=halfPi*double(i)/double(N-1),term=x,sum=x;
+        for(int k=1;k<12;k++){
+            term*=-x*x/double((2*k)*(2*k+1));
+            sum+=term;
+        }
+        table[i]=sum;
+    }
+    return table;
+}
+constexpr auto sineTable=makeSineTable<91>();
+static_assert(sineTable[90]>0.9999999&&sineTable[90]<1.0000001);
+
+static_assert(Array<int,3>{1,2}==Array<int,3>{1,2,0});
+static_assert(Array<int,4>{}==Array<int,4>{0,0,0,0});
+static_assert(Array<Array<int,2>,2>{{1,2}}==Array<Array<int,2>,2>{{1,2},{0,0}});
+static_assert(Array<Array<int,2>,2>{{1}}[0][1]==0);
+static_assert(*(Array<int,3>{4,5,6}.begin()+2)==6);
+
+//the same std:: algorithms over Array and std::array, timed
+template<class Container>
+double saxpyTime(Container& x, Container& y, int rounds){
+    auto start=chrono::steady_clock::now();
+    float sum=0;
+    for(int r=0;r<rounds;r++){
+        transform(x.begin(),x.end(),y.begin(),y.begin(),[](float a,float b){return 2.f*a+b;});
+        sum+=*max_element(y.begin(),y.end());
+    }
+    chrono::duration<double> elapsed=chrono::steady_clock::now()-start;
+    if(sum<0) cout<<sum;//keep the work observable
+    return elapsed.count();
+}
+
+template<size_t N>
+void matrixBenchmark(){
+    auto a=make_unique<MdArray<float,N,N>>();
+    auto b=make_unique<MdArray<float,N,N>>();
+    auto c=make_unique<MdArray<float,N,N>>();
+    auto d=make_unique<MdArray<float,N,N>>();
+    for(size_t i=0;i<N;i++)
+        for(size_t j=0;j<N;j++){
+            (*a)(i,j)=float((i+j)%5);
+            (*b)(i,j)=float((i*j)%3);
+        }
+    auto start=chrono::steady_clock::now();
+    multiplyBlocked<float>(a->view(),b->view(),c->view(),N);//one tile: plain i-k-j loop
+    chrono::duration<double> plain=chrono::steady_clock::now()-start;
+    start=chrono::steady_clock::now();
+    multiplyBlocked<float>(a->view(),b->view(),d->view(),64);
+    chrono::duration<double> blocked=chrono::steady_clock::now()-start;
+    cout<<N<<"x"<<N<<" float multiply: untiled "<<plain.count()<<" s, 64x64 tiles "
+        <<blocked.count()<<" s"<<(equal(c->begin(),c->end(),d->begin())?"":" MISMATCH")<<endl;
+}
+
+//a*x+y over many vectors, written as an expression and as a hand loop
+template<size_t N>
+void expressionBenchmark(){
+    constexpr int rounds=(1<<24)/N;
+    auto x=make_unique<Array<float,N>>();
+    auto y=make_unique<Array<float,N>>();
+    auto z=make_unique<Array<float,N>>();
+    auto init=[&]{
+        for(size_t i=0;i<N;i++){
+            (*x)[i]=float(i%5);
+            (*y)[i]=float(i%3);
+        }
+    };
+    init();
+    double exprTotal=0,loopTotal=0;
+    auto start=chrono::steady_clock::now();
+    for(int r=0;r<rounds;r++){
+        *z=fma(*x,0.5f,*y)-*x*0.25f;
+        exprTotal+=sum(*z);
+        (*x)[r%N]=float(r%7);//keeps the compiler from hoisting the work
     }
+    chrono::duration<double> expr=chrono::steady_clock::now()-start;
+    init();
+    start=chrono::steady_clock::now();
+    for(int r=0;r<rounds;r++){
+        float total=0;
+        for(size_t i=0;i<N;i++){
+            z->arr[i]=x->arr[i]*0.5f+y->arr[i]-x->arr[i]*0.25f;
+            total+=z->arr[i];
+        }
+        loopTotal+=total;
+        x->arr[r%N]=float(r%7);
+    }
+    chrono::duration<double> loop=chrono::steady_clock::now()-start;
+    cout<<"Array<float,"<<N<<"> fma/sum: expression "<<expr.count()<<" s, hand loop "
+        <<loop.count()<<" s"<<(abs(exprTotal-loopTotal)<=1e-5*abs(loopTotal)?"":" (results differ)")<<endl;
+}
+
+//many short lists: inline storage against one heap block each
+void smallArrayBenchmark(){
+    constexpr int rounds=1<<20;
+    long long check=0;
+    auto start=chrono::steady_clock::now();
+    for(int r=0;r<rounds;r++){
+        SmallArray<int,16> small;
+        for(int i=0;i<8+r%8;i++) small.push_back(i^r);
+        check+=accumulate(small.begin(),small.end(),0LL);
+    }
+    chrono::duration<double> inlineTime=chrono::steady_clock::now()-start;
+    start=chrono::steady_clock::now();
+    for(int r=0;r<rounds;r++){
+        vector<int> heap;
+        for(int i=0;i<8+r%8;i++) heap.push_back(i^r);
+        check-=accumulate(heap.begin(),heap.end(),0LL);
+    }
+    chrono::duration<double> heapTime=chrono::steady_clock::now()-start;
+    cout<<"8 to 15 pushes: SmallArray<int,16> "<<inlineTime.count()<<" s, std::vector "
+        <<heapTime.count()<<" s"<<(check?" (results differ)":"")<<endl;
+}
+
+struct Particle{
+    float x=0,y=0;
+    float vx=0,vy=0;
+    int id=0;
 };
+using Particles=SoA<Particle,1<<14,&Particle::x,&Particle::y,&Particle::vx,&Particle::vy,&Particle::id>;
 
-int main() {
+//moving particles field by field against the same structs side by side
+void soaBenchmark(){
+    constexpr int rounds=2000;
+    constexpr size_t n=Particles::size();
+    auto soa=make_unique<Particles>();
+    auto aos=make_unique<Array<Particle,n>>();
+    for(size_t i=0;i<n;i++){
+        Particle p{0,0,float(i%3),float(i%5),int(i)};
+        (*soa)[i]=p;
+        (*aos)[i]=p;
+    }
+    auto start=chrono::steady_clock::now();
+    for(int r=0;r<rounds;r++){
+        auto& x=soa->column<&Particle::x>();
+        x=fma(soa->column<&Particle::vx>(),0.01f,x);
+    }
+    chrono::duration<double> soaTime=chrono::steady_clock::now()-start;
+    start=chrono::steady_clock::now();
+    for(int r=0;r<rounds;r++)
+        for(auto& p:aos->arr) p.x+=p.vx*0.01f;
+    chrono::duration<double> aosTime=chrono::steady_clock::now()-start;
+    double soaSum=sum(soa->column<&Particle::x>()),aosSum=0;
+    for(auto& p:aos->arr) aosSum+=p.x;
+    cout<<"x+=vx*dt over "<<n<<" particles: SoA "<<soaTime.count()<<" s, AoS "<<aosTime.count()
+        <<" s"<<(abs(soaSum-aosSum)<=1e-3*aosSum?"":" (results differ)")<<endl;
+}
+
+void benchmark(){
+    constexpr size_t n=1<<14;
+    constexpr int rounds=20000;
+    auto a=make_unique<Array<float,n>>();
+    auto b=make_unique<Array<float,n>>();
+    auto c=make_unique<array<float,n>>();
+    auto d=make_unique<array<float,n>>();
+    for(size_t i=0;i<n;i++){
+        (*a)[i]=(*c)[i]=float(i%7);
+        (*b)[i]=(*d)[i]=0;
+    }
+    cout<<"transform+max_element over "<<n<<" floats x "<<rounds
+        <<(ARRAY_CHECKED?" (checked build)":" (unchecked build)")<<endl;
+    cout<<"Array      "<<saxpyTime(*a,*b,rounds)<<" s"<<endl;
+    cout<<"std::array "<<saxpyTime(*c,*d,rounds)<<" s"<<endl;
+    matrixBenchmark<512>();
+    expressionBenchmark<4>();
+    expressionBenchmark<16>();
+    expressionBenchmark<1024>();
+    smallArrayBenchmark();
+    soaBenchmark();
+}
+
+int main(int argc, char** argv) {
+    if(argc>1&&string(argv[1])=="bench"){
+        benchmark();
+        return 0;
+    }
     cout<<"1d array of integers"<<endl;
     Array<int,4>a{1,2,3,4};
     for(auto i:a) cout<<i;
@@ -163,6 +968,46 @@ int main() {
         cout<<endl;
     }
     cout<<endl; 
+    cout<<"3x4 matrix in one contiguous buffer"<<endl;
+    MdArray<int,3,4> m{1,2,3,4,5,6,7,8,9,10,11,12};
+    printMatrix(m.view());
+    cout<<"transposed view"<<endl;
+    printMatrix(m.view().transpose());
+    cout<<"2x2 sub-block view from row 1, column 1"<<endl;
+    printMatrix(m.view().sub(0,1,2).sub(1,1,2));
+    cout<<"column 2 slice: ";
+    auto column=m.view().slice(1,2);
+    for(size_t i=0;i<column.extent(0);i++) cout<<column(i)<<" ";
+    cout<<endl<<endl;
+    cout<<"vector math on Array<double,3>"<<endl;
+    Array<double,3> p{1,2,2},q{0,3,4};
+    Array<double,3> r=fma(p,2.0,q)-p/2.0;
+    cout<<"2p+q-p/2 = ";
+    for(auto v:r) cout<<v<<" ";
+    cout<<endl<<"|p| = "<<norm(p)<<", p.q = "<<dot(p,q)<<", max(q) = "<<max(q)<<endl<<endl;
+    cout<<"SmallArray<int,4> growing past its inline storage"<<endl;
+    SmallArray<int,4,32> small{1,2,3};
+    for(int i=4;i<=6;i++){
+        small.push_back(i);
+        cout<<"size "<<small.size()<<(small.isInline()?" inline":" on the heap")<<endl;
+    }
+    for(auto v:small) cout<<v;
+    cout<<endl<<endl;
+    cout<<"structure of arrays"<<endl;
+    SoA<Particle,3,&Particle::x,&Particle::vx,&Particle::id> few;
+    for(size_t i=0;i<3;i++) few[i]=Particle{float(i),0,0.5f,0,int(i)+10};
+    few.column<&Particle::x>()=few.column<&Particle::x>()+few.column<&Particle::vx>();
+    few[1].get<&Particle::id>()=42;
+    for(size_t i=0;i<3;i++){
+        Particle p=few[i];
+        cout<<"id "<<p.id<<" x "<<p.x<<endl;
+    }
+    cout<<endl;
+    cout<<"compile time tables"<<endl;
+    cout<<"crc32(\"123456789\") = "<<hex<<crc32("123456789")<<dec<<endl;
+    cout<<"UTF-8 length of lead byte 0xE2 = "<<int(utf8Length[0xE2])<<endl;
+    cout<<"sin(30 degrees) = "<<sineTable[30]<<endl;
+    cout<<endl;
     cout<<"2d array initialisation with std::array and extra necessary curly brackets that are little bit sucky. Just to showcase the difference"<<endl;
     array<array<int,4>,2> arr2{{
         {1,2,3,4},
@@ -6,6 +6,49 @@
 #include <iostream>
 #include <fstream>
 #include <random>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define FSU_POSIX 1
+    #include <cerrno>
+    #include <dirent.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/uio.h>
+    #include <climits>
+    #include <unistd.h>
+    #ifdef __linux__
+        #include <sys/syscall.h>
+        #include <sys/ioctl.h>
+        #include <sys/sendfile.h>
+        #include <linux/fs.h>
+        #include <poll.h>
+        #include <sys/eventfd.h>
+        #include <sys/inotify.h>
+        #define FSU_INOTIFY 1
+        #if __has_include(<linux/io_uring.h>)
+            #define FSU_IO_URING 1
+            #include <linux/io_uring.h>
+        #endif
+    #endif
+#endif
 
 /**
  * @namespace fsu
@@ -51,15 +94,6 @@ inline bool createDirectories(const fs::path& path) {
     return fs::create_directories(path);
 }
 
-/**
- * @brief Deletes a file or directory (recursively).
- * @param path The path to delete.
- * @return true if deletion was successful.
- */
-inline bool remove(const fs::path& path) {
-    return fs::remove_all(path) > 0;
-}
-
 /**
  * @brief Deletes a single file (non-recursive).
  * @param path The path to the file.
@@ -75,50 +109,639 @@ inline bool deleteFile(const fs::path& path) {
 }
 
 /**
- * @brief Copies a file or directory to a new location.
+ * @brief Moves or renames a file or directory.
+ *
+ * If the destination exists, the move will fail.
+ * May fail across different mount points.
+ *
  * @param from Source path.
  * @param to Destination path.
- * @param recursive If true, performs recursive copy.
- * @return true if copy was successful.
+ * @return true if the move was successful.
  */
-inline bool copy(const fs::path& from, const fs::path& to, bool recursive = false) {
+inline bool move(const fs::path& from, const fs::path& to) {
     try {
-        if (recursive) {
-            fs::copy(from, to, fs::copy_options::recursive | fs::copy_options::overwrite_existing);
-        } else {
-            fs::copy(from, to, fs::copy_options::overwrite_existing);
-        }
+        fs::rename(from, to);
         return true;
     } catch (const std::exception& e) {
-        std::cerr << "Copy failed: " << e.what() << '\n';
+        std::cerr << "Move failed: " << e.what() << '\n';
         return false;
     }
 }
 
 /**
- * @brief Moves or renames a file or directory.
+ * @brief An entry reported by walk().
+ */
+struct DirEntry {
+    fs::path path;                              ///< Full path of the entry.
+    fs::file_type type = fs::file_type::none;   ///< Type from the directory itself, symlinks are not followed.
+    unsigned depth = 0;                         ///< 0 for entries directly inside the root.
+};
+
+/**
+ * @brief Options for walk().
+ */
+struct WalkOptions {
+    /// Worker threads, 0 means one per hardware thread.
+    unsigned threads = 0;
+    /// Called before an entry is reported; returning false skips it and, for a directory, everything below it.
+    std::function<bool(const DirEntry&)> filter;
+};
+
+namespace detail {
+
+/**
+ * @brief Runs tasks on a fixed set of threads, each with its own deque.
  *
- * If the destination exists, the move will fail.
- * May fail across different mount points.
+ * A worker takes its newest task first (depth first, which keeps the
+ * working set small) and steals the oldest task of another worker when
+ * it runs dry. Tasks may spawn more tasks; run() returns once none are
+ * left or stop() was called.
+ */
+template <class Task>
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threads)
+        : queues(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {
+        for (auto& q : queues) q = std::make_unique<Queue>();
+    }
+
+    /**
+     * @brief Processes roots and everything they spawn.
+     * @param roots Initial tasks.
+     * @param handler Called as handler(task, worker) from the worker threads.
+     */
+    template <class Handler>
+    void run(std::vector<Task> roots, Handler handler) {
+        stopped = false;
+        for (size_t i = 0; i < roots.size(); ++i) spawn(unsigned(i % queues.size()), std::move(roots[i]));
+        std::vector<std::thread> threads;
+        for (unsigned w = 1; w < queues.size(); ++w) {
+            threads.emplace_back([this, w, &handler] { work(w, handler); });
+        }
+        work(0, handler);
+        for (auto& t : threads) t.join();
+        for (auto& q : queues) q->tasks.clear();
+        pending = 0;
+    }
+
+    /// Queues a task on the given worker; safe to call from handlers.
+    void spawn(unsigned worker, Task task) {
+        pending.fetch_add(1, std::memory_order_relaxed);
+        Queue& q = *queues[worker % queues.size()];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.tasks.push_back(std::move(task));
+    }
+
+    /// Makes run() return soon, dropping tasks that have not started.
+    void stop() { stopped = true; }
+
+    unsigned size() const { return unsigned(queues.size()); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::atomic<size_t> pending{0};
+    std::atomic<bool> stopped{false};
+
+    bool take(unsigned worker, Task& task) {
+        {
+            Queue& own = *queues[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); ++i) {
+            Queue& victim = *queues[(worker + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <class Handler>
+    void work(unsigned worker, Handler& handler) {
+        unsigned idle = 0;
+        while (!stopped) {
+            Task task;
+            if (take(worker, task)) {
+                idle = 0;
+                try {
+                    handler(task, worker);
+                } catch (const std::exception& e) {
+                    std::cerr << "Task failed: " << e.what() << '\n';
+                }
+                pending.fetch_sub(1, std::memory_order_acq_rel);
+            } else if (pending.load(std::memory_order_acquire) == 0) {
+                return;
+            } else if (++idle < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+};
+
+#ifdef FSU_POSIX
+/// Closes a file descriptor on scope exit.
+class UniqueFd {
+public:
+    explicit UniqueFd(int descriptor = -1) : fd(descriptor) {}
+    ~UniqueFd() { reset(); }
+    UniqueFd(UniqueFd&& other) noexcept : fd(other.release()) {}
+    UniqueFd& operator=(UniqueFd&& other) noexcept {
+        if (this != &other) reset(other.release());
+        return *this;
+    }
+
+    int get() const { return fd; }
+    explicit operator bool() const { return fd >= 0; }
+    int release() { int result = fd; fd = -1; return result; }
+    void reset(int newFd = -1) {
+        if (fd >= 0) ::close(fd);
+        fd = newFd;
+    }
+
+private:
+    int fd;
+};
+
+inline std::error_code lastError() { return std::error_code(errno, std::generic_category()); }
+
+inline fs::file_type fromDirentType(unsigned char type) {
+    switch (type) {
+        case DT_REG:  return fs::file_type::regular;
+        case DT_DIR:  return fs::file_type::directory;
+        case DT_LNK:  return fs::file_type::symlink;
+        case DT_BLK:  return fs::file_type::block;
+        case DT_CHR:  return fs::file_type::character;
+        case DT_FIFO: return fs::file_type::fifo;
+        case DT_SOCK: return fs::file_type::socket;
+        default:      return fs::file_type::unknown;
+    }
+}
+
+inline fs::file_type fromMode(mode_t mode) {
+    if (S_ISREG(mode))  return fs::file_type::regular;
+    if (S_ISDIR(mode))  return fs::file_type::directory;
+    if (S_ISLNK(mode))  return fs::file_type::symlink;
+    if (S_ISBLK(mode))  return fs::file_type::block;
+    if (S_ISCHR(mode))  return fs::file_type::character;
+    if (S_ISFIFO(mode)) return fs::file_type::fifo;
+    if (S_ISSOCK(mode)) return fs::file_type::socket;
+    return fs::file_type::unknown;
+}
+
+/**
+ * @brief Reads the names in an open directory without a stat per entry.
  *
- * @param from Source path.
- * @param to Destination path.
- * @return true if the move was successful.
+ * Uses getdents64 with a large buffer on Linux and readdir elsewhere.
+ * The entry type comes from d_type; only file systems that do not fill
+ * it in cost an fstatat.
  */
-inline bool move(const fs::path& from, const fs::path& to) {
+class DirReader {
+public:
+    /// Takes ownership of a directory file descriptor.
+    explicit DirReader(int fd) : dirfd(fd) {
+    #ifndef __linux__
+        dir = fdopendir(fd);
+        if (!dir) { ::close(fd); dirfd = -1; }
+    #endif
+    }
+
+    ~DirReader() {
+    #ifdef __linux__
+        if (dirfd >= 0) ::close(dirfd);
+    #else
+        if (dir) closedir(dir);
+    #endif
+    }
+
+    DirReader(const DirReader&) = delete;
+    DirReader& operator=(const DirReader&) = delete;
+
+    /**
+     * @brief Opens name relative to the directory parent (AT_FDCWD for a plain path).
+     *
+     * A plain path is a root given by the caller and may be a symlink to a
+     * directory; an entry opened relative to its parent never follows one.
+     */
+    static std::unique_ptr<DirReader> open(int parent, const char* name) {
+        int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+        if (parent != AT_FDCWD) flags |= O_NOFOLLOW;
+        int fd = ::openat(parent, name, flags);
+        if (fd < 0) return nullptr;
+        auto reader = std::make_unique<DirReader>(fd);
+        return reader->fd() >= 0 ? std::move(reader) : nullptr;
+    }
+
+    int fd() const { return dirfd; }
+
+    /**
+     * @brief Advances to the next entry, skipping "." and "..".
+     * @return false at the end of the directory or on error.
+     */
+    bool next(std::string_view& name, fs::file_type& type) {
+        for (;;) {
+        #ifdef __linux__
+            if (offset >= filled) {
+                long n = syscall(SYS_getdents64, dirfd, buffer.get(), BufferSize);
+                if (n <= 0) return false;
+                filled = size_t(n);
+                offset = 0;
+            }
+            auto* entry = reinterpret_cast<LinuxDirent*>(buffer.get() + offset);
+            offset += entry->reclen;
+            const char* entryName = entry->name;
+            unsigned char entryType = entry->type;
+        #else
+            struct dirent* entry = readdir(dir);
+            if (!entry) return false;
+            const char* entryName = entry->d_name;
+            unsigned char entryType = entry->d_type;
+        #endif
+            if (entryName[0] == '.' && (entryName[1] == 0 || (entryName[1] == '.' && entryName[2] == 0))) continue;
+            name = entryName;
+            type = fromDirentType(entryType);
+            if (type == fs::file_type::unknown) {
+                struct stat st;
+                if (::fstatat(dirfd, entryName, &st, AT_SYMLINK_NOFOLLOW) == 0) type = fromMode(st.st_mode);
+            }
+            return true;
+        }
+    }
+
+private:
+    int dirfd = -1;
+#ifdef __linux__
+    struct LinuxDirent {
+        uint64_t ino;
+        int64_t off;
+        unsigned short reclen;
+        unsigned char type;
+        char name[1];
+    };
+    static constexpr size_t BufferSize = 64 * 1024;
+    std::unique_ptr<char[]> buffer{new char[BufferSize]};
+    size_t offset = 0;
+    size_t filled = 0;
+#else
+    DIR* dir = nullptr;
+#endif
+};
+#endif // FSU_POSIX
+
+} // namespace detail
+
+/**
+ * @brief Walks a directory tree in parallel, streaming entries to a callback.
+ *
+ * Directories are listed by a pool of work-stealing threads. On POSIX
+ * systems each directory is opened with openat() relative to its parent
+ * and read with getdents64/readdir, using d_type so that no entry needs
+ * a stat. Symbolic links are reported but not followed.
+ *
+ * @param root Directory to walk (not reported itself).
+ * @param onEntry Called for every entry, concurrently from the worker threads;
+ *                return false to stop the walk early.
+ * @param options Thread count and an optional filter that prunes entries.
+ * @return true if every directory could be read and the walk was not stopped.
+ */
+inline bool walk(const fs::path& root,
+                 const std::function<bool(const DirEntry&)>& onEntry,
+                 const WalkOptions& options = {}) {
+#ifdef FSU_POSIX
+    struct Task {
+        std::shared_ptr<detail::DirReader> parent;  // keeps the parent fd open for openat
+        fs::path path;
+        unsigned depth = 0;
+    };
+    auto top = detail::DirReader::open(AT_FDCWD, root.c_str());
+    if (!top) {
+        std::cerr << "Directory listing failed: " << root << ": " << std::strerror(errno) << '\n';
+        return false;
+    }
+    std::atomic<bool> ok{true};
+    detail::WorkStealingPool<Task> pool(options.threads);
+    std::vector<Task> roots(1);
+    roots[0].path = root;
+    std::shared_ptr<detail::DirReader> rootReader(std::move(top));
+    pool.run(std::move(roots), [&](Task& task, unsigned worker) {
+        std::shared_ptr<detail::DirReader> reader = task.depth == 0 ? rootReader : nullptr;
+        if (!reader) {
+            reader = detail::DirReader::open(task.parent->fd(), task.path.filename().c_str());
+            task.parent.reset();
+            if (!reader) {
+                std::cerr << "Directory listing failed: " << task.path << ": " << std::strerror(errno) << '\n';
+                ok = false;
+                return;
+            }
+        }
+        std::string_view name;
+        DirEntry entry;
+        entry.depth = task.depth;
+        while (reader->next(name, entry.type)) {
+            entry.path = task.path / name;
+            if (options.filter && !options.filter(entry)) continue;
+            if (!onEntry(entry)) {
+                ok = false;
+                pool.stop();
+                return;
+            }
+            if (entry.type == fs::file_type::directory) {
+                pool.spawn(worker, Task{reader, entry.path, task.depth + 1});
+            }
+        }
+    });
+    return ok;
+#else
     try {
-        fs::rename(from, to);
+        for (auto it = fs::recursive_directory_iterator(root); it != fs::recursive_directory_iterator(); ++it) {
+            DirEntry entry{it->path(), it->symlink_status().type(), unsigned(it.depth())};
+            if (options.filter && !options.filter(entry)) {
+                if (entry.type == fs::file_type::directory) it.disable_recursion_pending();
+                continue;
+            }
+            if (!onEntry(entry)) return false;
+        }
         return true;
     } catch (const std::exception& e) {
-        std::cerr << "Move failed: " << e.what() << '\n';
+        std::cerr << "Directory listing failed: " << e.what() << '\n';
         return false;
     }
+#endif
+}
+
+/**
+ * @brief Matches a file name against a shell glob.
+ *
+ * Supports '*', '?' and bracket classes such as [abc], [a-z] and [!x].
+ *
+ * @param pattern Glob pattern.
+ * @param name File name to test.
+ * @return true if the whole name matches.
+ */
+inline bool globMatch(std::string_view pattern, std::string_view name) {
+    size_t p = 0, n = 0, starP = std::string_view::npos, starN = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && pattern[p] == '*') {
+            starP = p++;
+            starN = n;
+            continue;
+        }
+        if (p < pattern.size() && pattern[p] == '[') {
+            size_t q = p + 1;
+            bool negate = q < pattern.size() && (pattern[q] == '!' || pattern[q] == '^');
+            if (negate) ++q;
+            bool matched = false;
+            size_t first = q;
+            while (q < pattern.size() && (pattern[q] != ']' || q == first)) {
+                if (q + 2 < pattern.size() && pattern[q + 1] == '-' && pattern[q + 2] != ']') {
+                    matched |= pattern[q] <= name[n] && name[n] <= pattern[q + 2];
+                    q += 3;
+                } else {
+                    matched |= pattern[q++] == name[n];
+                }
+            }
+            if (q < pattern.size() && matched != negate) {
+                p = q + 1;
+                ++n;
+                continue;
+            }
+        } else if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            ++p;
+            ++n;
+            continue;
+        }
+        if (starP == std::string_view::npos) return false;
+        p = starP + 1;
+        n = ++starN;
+    }
+    while (p < pattern.size() && pattern[p] == '*') ++p;
+    return p == pattern.size();
 }
 
+/**
+ * @brief Options for DirectoryStream.
+ */
+struct ListOptions {
+    /// Deepest level descended into; 0 lists only the directory itself.
+    unsigned maxDepth = std::numeric_limits<unsigned>::max();
+    /// If not empty, only entries whose name matches one of these globs are yielded (directories are still descended).
+    std::vector<std::string> include;
+    /// Entries whose name matches one of these globs are neither yielded nor descended.
+    std::vector<std::string> exclude;
+};
+
+/**
+ * @brief A lazy, depth-first listing of a directory tree.
+ *
+ * Entries are read as the range is iterated, so memory stays bounded by
+ * the tree depth and breaking out of the loop stops the scan. Each entry
+ * carries the type read from the directory; on POSIX systems stat() is
+ * fetched with fstatat() on first use and cached. Symbolic links are not
+ * followed.
+ *
+ * @code
+ * fsu::ListOptions options;
+ * options.maxDepth = 2;
+ * options.exclude = {".git", "build*"};
+ * for (const auto& entry : fsu::DirectoryStream("src", options)) {
+ *     std::cout << entry.path << '\n';
+ * }
+ * @endcode
+ */
+class DirectoryStream {
+public:
+    /**
+     * @brief An entry yielded by DirectoryStream.
+     */
+    class Entry : public DirEntry {
+    public:
+    #ifdef FSU_POSIX
+        /// lstat() information, or nullptr if it could not be read.
+        const struct stat* stat() const {
+            if (!statDone) {
+                statOk = ::fstatat(dir->fd(), path.filename().c_str(), &statBuffer, AT_SYMLINK_NOFOLLOW) == 0;
+                statDone = true;
+            }
+            return statOk ? &statBuffer : nullptr;
+        }
+    #endif
+
+    private:
+        friend class DirectoryStream;
+    #ifdef FSU_POSIX
+        std::shared_ptr<detail::DirReader> dir;  // keeps the parent open for stat()
+        mutable struct stat statBuffer {};
+        mutable bool statDone = false;
+        mutable bool statOk = false;
+    #endif
+    };
+
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Entry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Entry*;
+        using reference = const Entry&;
+
+        iterator() = default;
+        reference operator*() const { return stream->current; }
+        pointer operator->() const { return &stream->current; }
+        iterator& operator++() {
+            if (!stream->advance()) stream = nullptr;
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+        bool operator==(const iterator& other) const { return stream == other.stream; }
+        bool operator!=(const iterator& other) const { return stream != other.stream; }
+
+    private:
+        friend class DirectoryStream;
+        explicit iterator(DirectoryStream* owner) : stream(owner) {}
+        DirectoryStream* stream = nullptr;
+    };
+
+    /**
+     * @brief Opens the directory; nothing below it is read until iteration.
+     * @param dir Directory to list.
+     * @param options Depth limit and glob filters.
+     */
+    explicit DirectoryStream(const fs::path& dir, ListOptions options = {})
+        : options(std::move(options)) {
+        push(dir, 0);
+    }
+
+    /// Starts the iteration; a stream can be iterated once.
+    iterator begin() { return advance() ? iterator(this) : iterator(); }
+    iterator end() { return iterator(); }
+
+    /// Does not descend into the directory that was yielded last.
+    void skipDirectory() { descendPending = false; }
+
+private:
+    struct Frame {
+    #ifdef FSU_POSIX
+        std::shared_ptr<detail::DirReader> reader;
+    #else
+        fs::directory_iterator it;
+    #endif
+        fs::path path;
+        unsigned depth = 0;
+    };
+
+    ListOptions options;
+    std::vector<Frame> stack;
+    Entry current;
+    bool descendPending = false;
+
+    static bool matchesAny(const std::vector<std::string>& patterns, std::string_view name) {
+        for (const auto& pattern : patterns) {
+            if (globMatch(pattern, name)) return true;
+        }
+        return false;
+    }
+
+    void push(const fs::path& dir, unsigned depth) {
+        Frame frame;
+        frame.path = dir;
+        frame.depth = depth;
+    #ifdef FSU_POSIX
+        int parent = AT_FDCWD;
+        fs::path name = dir;
+        if (!stack.empty() && current.dir) {
+            parent = current.dir->fd();
+            name = dir.filename();
+        }
+        frame.reader = detail::DirReader::open(parent, name.c_str());
+        if (!frame.reader) {
+            std::cerr << "Directory listing failed: " << dir << ": " << std::strerror(errno) << '\n';
+            return;
+        }
+    #else
+        std::error_code ec;
+        frame.it = fs::directory_iterator(dir, ec);
+        if (ec) {
+            std::cerr << "Directory listing failed: " << dir << ": " << ec.message() << '\n';
+            return;
+        }
+    #endif
+        stack.push_back(std::move(frame));
+    }
+
+    void descend() {
+        if (descendPending) {
+            descendPending = false;
+            push(current.path, current.depth + 1);
+        }
+    }
+
+    bool advance() {
+        descend();
+    #ifndef FSU_POSIX
+        std::string nameBuffer;
+    #endif
+        while (!stack.empty()) {
+            Frame& frame = stack.back();
+            std::string_view name;
+            fs::file_type type;
+        #ifdef FSU_POSIX
+            if (!frame.reader->next(name, type)) {
+                stack.pop_back();
+                continue;
+            }
+        #else
+            if (frame.it == fs::directory_iterator()) {
+                stack.pop_back();
+                continue;
+            }
+            nameBuffer = frame.it->path().filename().string();
+            name = nameBuffer;
+            std::error_code ec;
+            type = frame.it->symlink_status(ec).type();
+            frame.it.increment(ec);
+            if (ec) frame.it = fs::directory_iterator();
+        #endif
+            if (matchesAny(options.exclude, name)) continue;
+            current.path = frame.path / name;
+            current.type = type;
+            current.depth = frame.depth;
+        #ifdef FSU_POSIX
+            if (current.dir != frame.reader) current.dir = frame.reader;
+            current.statDone = false;
+        #endif
+            descendPending = type == fs::file_type::directory && frame.depth < options.maxDepth;
+            if (!options.include.empty() && !matchesAny(options.include, name)) {
+                descend();
+                continue;
+            }
+            return true;
+        }
+        return false;
+    }
+};
+
 /**
  * @brief Lists all files (optionally recursive) in a directory.
+ *
+ * The recursive listing is produced by walk() on all hardware threads,
+ * so its order is unspecified. Prefer walk() or DirectoryStream for large
+ * trees: they stream entries instead of collecting them.
+ *
  * @param dir Directory path.
- * @param recursive If true, uses recursive iteration.
+ * @param recursive If true, lists the whole tree.
  * @return A vector of paths.
  */
 inline std::vector<fs::path> listFiles(const fs::path& dir, bool recursive = false) {
@@ -126,15 +749,19 @@ inline std::vector<fs::path> listFiles(const fs::path& dir, bool recursive = fal
 
     if (!fs::exists(dir) || !fs::is_directory(dir)) return result;
 
+    if (recursive) {
+        std::mutex mutex;
+        walk(dir, [&](const DirEntry& entry) {
+            std::lock_guard<std::mutex> lock(mutex);
+            result.push_back(entry.path);
+            return true;
+        });
+        return result;
+    }
+
     try {
-        if (recursive) {
-            for (const auto& entry : fs::recursive_directory_iterator(dir)) {
-                result.push_back(entry.path());
-            }
-        } else {
-            for (const auto& entry : fs::directory_iterator(dir)) {
-                result.push_back(entry.path());
-            }
+        for (const auto& entry : fs::directory_iterator(dir)) {
+            result.push_back(entry.path());
         }
     } catch (const std::exception& e) {
         std::cerr << "Directory listing failed: " << e.what() << '\n';
@@ -144,45 +771,2178 @@ inline std::vector<fs::path> listFiles(const fs::path& dir, bool recursive = fal
 }
 
 /**
- * @brief Reads the entire content of a text file.
- * @param path The file path.
- * @return String with file contents.
+ * @brief Caches file types and directory listings, kept coherent with inotify.
+ *
+ * Queries are answered from hash maps under a shared lock; a miss costs one
+ * stat (or one directory read) and installs an inotify watch on the parent
+ * directory. A background thread applies events as they arrive, dropping
+ * the affected entries, so results are current to within the event
+ * delivery latency. Negative results (missing files) are cached too. The
+ * type of a path that is itself a symbolic link is looked up every time,
+ * since its target lies outside the watched parent.
+ *
+ * Relative paths are resolved against the working directory at
+ * construction. Changes above a watched directory, such as renaming an
+ * ancestor or retargeting a symbolic link in the path, are not reported by
+ * inotify; call invalidate() after making them. Without inotify the cache
+ * is disabled and every query goes to the file system.
+ *
+ * @code
+ * fsu::TreeCache cache;
+ * if (cache.isFile(config)) load(config);
+ * for (const auto& plugin : cache.listFiles(pluginDir)) probe(plugin);
+ * @endcode
  */
-inline std::string readFile(const fs::path& path) {
-    std::ifstream in(path);
-    if (!in) return "";
-    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
-}
+class TreeCache {
+public:
+    TreeCache() : cwd(fs::current_path()) {
+    #ifdef FSU_INOTIFY
+        inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (inotifyFd < 0 || wakeFd < 0) {
+            std::cerr << "inotify unavailable, TreeCache disabled: " << std::strerror(errno) << '\n';
+            closeDescriptors();
+            return;
+        }
+        watcher = std::thread([this] { watch(); });
+    #endif
+    }
+
+    ~TreeCache() {
+    #ifdef FSU_INOTIFY
+        if (watcher.joinable()) {
+            uint64_t one = 1;
+            ssize_t written = ::write(wakeFd, &one, sizeof(one));
+            (void)written;
+            watcher.join();
+        }
+        closeDescriptors();
+    #endif
+    }
+
+    TreeCache(const TreeCache&) = delete;
+    TreeCache& operator=(const TreeCache&) = delete;
+
+    /// True if changes are tracked and results cached.
+    bool enabled() const { return inotifyFd >= 0; }
+
+    /**
+     * @brief Type of the file at path, following symlinks.
+     * @return fs::file_type::not_found if missing, fs::file_type::none if it could not be checked.
+     */
+    fs::file_type status(const fs::path& path) {
+        std::string key = normalize(path);
+        if (!enabled()) return query(key);
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = entries.find(key);
+            if (it != entries.end()) return it->second;
+        }
+        uint64_t generation;
+        std::string parent = parentOf(key);
+        if (!watchDirectory(parent, generation)) return query(key);
+        bool linked = false;
+        fs::file_type type = query(key, &linked);
+        if (type != fs::file_type::none && !linked) {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            auto dir = directories.find(parent);
+            if (dir != directories.end() && dir->second.generation == generation) entries[key] = type;
+        }
+        return type;
+    }
+
+    bool exists(const fs::path& path) {
+        fs::file_type type = status(path);
+        return type != fs::file_type::not_found && type != fs::file_type::none;
+    }
+    bool isFile(const fs::path& path) { return status(path) == fs::file_type::regular; }
+    bool isDirectory(const fs::path& path) { return status(path) == fs::file_type::directory; }
+
+    /**
+     * @brief Lists a directory (non-recursive), like fsu::listFiles().
+     * @param dir Directory path; returned paths are dir / name.
+     */
+    std::vector<fs::path> listFiles(const fs::path& dir) {
+        std::string key = normalize(dir);
+        std::vector<std::string> names;
+        bool cached = false;
+        if (enabled()) {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = directories.find(key);
+            if (it != directories.end() && it->second.listed) {
+                names = it->second.listing;
+                cached = true;
+            }
+        }
+        if (!cached) {
+            uint64_t generation = 0;
+            bool watched = enabled() && watchDirectory(key, generation);
+            if (!readNames(key, names)) return {};
+            if (watched) {
+                std::unique_lock<std::shared_mutex> lock(mutex);
+                auto it = directories.find(key);
+                if (it != directories.end() && it->second.generation == generation) {
+                    it->second.listing = names;
+                    it->second.listed = true;
+                }
+            }
+        }
+        std::vector<fs::path> result;
+        result.reserve(names.size());
+        for (const auto& name : names) result.push_back(dir / name);
+        return result;
+    }
+
+    /// Drops cached data for path and everything below it.
+    void invalidate(const fs::path& path) {
+        std::string key = normalize(path);
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        dropTree(key);
+        auto parent = directories.find(parentOf(key));
+        if (parent != directories.end()) forget(parent->second);
+    }
+
+    /// Drops all cached data; watches are kept.
+    void clear() {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        entries.clear();
+        for (auto& dir : directories) forget(dir.second);
+    }
+
+private:
+    struct Directory {
+        int wd = -1;
+        uint64_t generation = 0;  // bumped on every event, so racing lookups do not cache stale results
+        bool listed = false;
+        std::vector<std::string> listing;
+    };
+
+    fs::path cwd;
+    std::shared_mutex mutex;
+    std::unordered_map<std::string, fs::file_type> entries;
+    std::unordered_map<std::string, Directory> directories;
+    std::unordered_map<int, std::vector<std::string>> watches;  // one inode can be reached by several paths
+    int inotifyFd = -1;
+#ifdef FSU_INOTIFY
+    int wakeFd = -1;
+    std::thread watcher;
+#endif
+
+    /// True for absolute paths without empty, "." or ".." components, which need no normalization.
+    static bool isNormal(const std::string& path) {
+        if (path.empty() || path[0] != '/') return false;
+        for (size_t i = 0; i + 1 < path.size(); ++i) {
+            if (path[i] != '/') continue;
+            if (path[i + 1] == '/') return false;
+            if (path[i + 1] == '.') {
+                size_t end = i + 2;
+                if (end < path.size() && path[end] == '.') ++end;
+                if (end == path.size() || path[end] == '/') return false;
+            }
+        }
+        return true;
+    }
+
+    std::string normalize(const fs::path& path) const {
+        std::string key = isNormal(path.native()) ? path.native()
+                                                  : (path.is_absolute() ? path : cwd / path).lexically_normal().native();
+        if (key.size() > 1 && key.back() == fs::path::preferred_separator) key.pop_back();
+        return key;
+    }
+
+    static std::string parentOf(const std::string& key) {
+        size_t slash = key.find_last_of(fs::path::preferred_separator);
+        if (slash == std::string::npos) return key;
+        return slash == 0 ? key.substr(0, 1) : key.substr(0, slash);
+    }
+
+    static bool isBelow(const std::string& key, const std::string& prefix) {
+        return key.size() > prefix.size() && key.compare(0, prefix.size(), prefix) == 0 &&
+               (key[prefix.size()] == fs::path::preferred_separator || prefix.size() == 1);
+    }
+
+    /// Type at key following links; *linked is set if key is a symbolic link.
+    static fs::file_type query(const std::string& key, bool* linked = nullptr) {
+        std::error_code ec;
+        fs::file_status status = fs::symlink_status(key, ec);
+        if (!ec && fs::is_symlink(status)) {
+            if (linked) *linked = true;
+            status = fs::status(key, ec);
+        }
+        if (ec && status.type() != fs::file_type::not_found) return fs::file_type::none;
+        return status.type();
+    }
+
+    static bool readNames(const std::string& key, std::vector<std::string>& names) {
+    #ifdef FSU_POSIX
+        auto reader = detail::DirReader::open(AT_FDCWD, key.c_str());
+        if (!reader) return false;
+        std::string_view name;
+        fs::file_type type;
+        while (reader->next(name, type)) names.emplace_back(name);
+    #else
+        std::error_code ec;
+        for (fs::directory_iterator it(key, ec), end; !ec && it != end; it.increment(ec)) {
+            names.push_back(it->path().filename().string());
+        }
+        if (ec) return false;
+    #endif
+        return true;
+    }
+
+    static void forget(Directory& dir) {
+        ++dir.generation;
+        dir.listed = false;
+        dir.listing.clear();
+    }
+
+    bool watchDirectory(const std::string& key, uint64_t& generation) {
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = directories.find(key);
+            if (it != directories.end()) {
+                generation = it->second.generation;
+                return true;
+            }
+        }
+    #ifdef FSU_INOTIFY
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto it = directories.find(key);
+        if (it == directories.end()) {
+            constexpr uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+                                      IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+            int wd = ::inotify_add_watch(inotifyFd, key.c_str(), mask);
+            if (wd < 0) return false;
+            it = directories.emplace(key, Directory()).first;
+            it->second.wd = wd;
+            watches[wd].push_back(key);
+        }
+        generation = it->second.generation;
+        return true;
+    #else
+        return false;
+    #endif
+    }
+
+    /// Forgets key and everything below it, removing their watches.
+    void dropTree(const std::string& key) {
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (it->first == key || isBelow(it->first, key)) it = entries.erase(it);
+            else ++it;
+        }
+        for (auto it = directories.begin(); it != directories.end();) {
+            if (it->first != key && !isBelow(it->first, key)) {
+                ++it;
+                continue;
+            }
+            unwatch(it->second.wd, it->first);
+            it = directories.erase(it);
+        }
+    }
+
+    void unwatch(int wd, const std::string& key) {
+        auto watch = watches.find(wd);
+        if (watch == watches.end()) return;
+        auto& keys = watch->second;
+        keys.erase(std::remove(keys.begin(), keys.end(), key), keys.end());
+        if (keys.empty()) {
+        #ifdef FSU_INOTIFY
+            ::inotify_rm_watch(inotifyFd, wd);
+        #endif
+            watches.erase(watch);
+        }
+    }
+
+#ifdef FSU_INOTIFY
+    void closeDescriptors() {
+        if (inotifyFd >= 0) ::close(inotifyFd);
+        if (wakeFd >= 0) ::close(wakeFd);
+        inotifyFd = wakeFd = -1;
+    }
+
+    void watch() {
+        alignas(struct inotify_event) char buffer[64 * 1024];
+        for (;;) {
+            struct pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+            if (::poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            if (fds[1].revents) return;
+            ssize_t n = ::read(inotifyFd, buffer, sizeof(buffer));
+            if (n <= 0) continue;
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            for (char* p = buffer; p < buffer + n;) {
+                auto* event = reinterpret_cast<struct inotify_event*>(p);
+                apply(*event);
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+
+    void apply(const struct inotify_event& event) {
+        if (event.mask & IN_Q_OVERFLOW) {
+            entries.clear();
+            for (auto& dir : directories) forget(dir.second);
+            return;
+        }
+        auto watch = watches.find(event.wd);
+        if (watch == watches.end()) return;
+        std::vector<std::string> keys = watch->second;
+        for (const auto& key : keys) {
+            if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                // The watch follows the inode, not the path: start over for this subtree.
+                dropTree(key);
+                continue;
+            }
+            auto dir = directories.find(key);
+            if (dir != directories.end()) forget(dir->second);
+            if (event.len) {
+                std::string child = key.size() == 1 ? key + event.name : key + '/' + event.name;
+                if (event.mask & IN_ISDIR && event.mask & (IN_DELETE | IN_MOVED_FROM)) dropTree(child);
+                else entries.erase(child);
+            }
+        }
+    }
+#endif
+};
 
 /**
- * @brief Writes a string to a file (overwrites).
+ * @brief Reads a whole file into a string.
+ *
+ * The file is opened in binary mode. On POSIX systems the buffer is sized
+ * once from fstat() and filled with a few large read() calls; files that
+ * report no size (such as /proc entries) are read in chunks until EOF.
+ *
  * @param path The file path.
- * @param content The content to write.
- * @return true on success.
+ * @param ec Set to the error on failure, cleared on success.
+ * @return String with file contents, empty on failure.
  */
-inline bool writeFile(const fs::path& path, const std::string& content) {
-    std::ofstream out(path);
-    if (!out) return false;
-    out << content;
-    return true;
+inline std::string readFile(const fs::path& path, std::error_code& ec) {
+    ec.clear();
+    std::string content;
+#ifdef FSU_POSIX
+    detail::UniqueFd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd) {
+        ec = detail::lastError();
+        return content;
+    }
+    struct stat st;
+    if (::fstat(fd.get(), &st) != 0) {
+        ec = detail::lastError();
+        return content;
+    }
+    size_t capacity = S_ISREG(st.st_mode) && st.st_size > 0 ? size_t(st.st_size) : 64 * 1024;
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(fd.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    // One byte of slack lets a file of the expected size finish with a single extra read() returning 0.
+    content.resize(capacity + 1);
+    size_t filled = 0;
+    for (;;) {
+        if (filled == content.size()) content.resize(content.size() * 2);
+        ssize_t n = ::read(fd.get(), &content[filled], content.size() - filled);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ec = detail::lastError();
+            return std::string();
+        }
+        if (n == 0) break;
+        filled += size_t(n);
+    }
+    content.resize(filled);
+#else
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        ec = std::make_error_code(std::errc::no_such_file_or_directory);
+        return content;
+    }
+    std::streamsize size = in.seekg(0, std::ios::end) ? std::streamsize(in.tellg()) : -1;
+    in.clear();
+    in.seekg(0);
+    if (size > 0) {
+        content.resize(size_t(size));
+        in.read(&content[0], size);
+        content.resize(size_t(in.gcount()));
+    } else {
+        content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    if (in.bad()) {
+        ec = std::make_error_code(std::errc::io_error);
+        content.clear();
+    }
+#endif
+    return content;
 }
 
 /**
- * @brief Generates a unique temporary file name.
+ * @brief Reads a whole file into a string.
+ * @param path The file path.
+ * @return String with file contents, empty on error; use the error_code
+ *         overload to tell a failure from an empty file.
+ */
+inline std::string readFile(const fs::path& path) {
+    std::error_code ec;
+    return readFile(path, ec);
+}
+
+/**
+ * @brief A read-only memory mapping of a whole file.
+ *
+ * Pages are loaded on first access, so large files can be scanned without
+ * copying them into the heap. The view stays valid until the object is
+ * destroyed; truncating the file meanwhile makes accesses past the new end
+ * fault. Platforms without mmap fall back to reading the file.
+ *
+ * @code
+ * std::error_code ec;
+ * fsu::MappedFile file("data.bin", ec);
+ * if (!ec) parse(file.view());
+ * @endcode
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    /**
+     * @brief Maps a file.
+     * @param path The file path.
+     * @param ec Set to the error on failure.
+     * @param sequential Hints the kernel to read ahead aggressively.
+     */
+    MappedFile(const fs::path& path, std::error_code& ec, bool sequential = false) {
+        ec.clear();
+    #ifdef FSU_POSIX
+        detail::UniqueFd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        struct stat st;
+        if (!fd || ::fstat(fd.get(), &st) != 0) {
+            ec = detail::lastError();
+            return;
+        }
+        if (!S_ISREG(st.st_mode)) {
+            ec = std::make_error_code(std::errc::invalid_argument);
+            return;
+        }
+        length = size_t(st.st_size);
+        if (length == 0) return;
+        void* mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+        if (mapping == MAP_FAILED) {
+            ec = detail::lastError();
+            length = 0;
+            return;
+        }
+        if (sequential) ::madvise(mapping, length, MADV_SEQUENTIAL);
+        address = static_cast<const char*>(mapping);
+    #else
+        (void)sequential;
+        fallback = readFile(path, ec);
+        address = fallback.data();
+        length = fallback.size();
+    #endif
+    }
+
+    ~MappedFile() { unmap(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            unmap();
+        #ifdef FSU_POSIX
+            address = other.address;
+        #else
+            fallback = std::move(other.fallback);
+            address = fallback.data();
+        #endif
+            length = other.length;
+            other.address = nullptr;
+            other.length = 0;
+        }
+        return *this;
+    }
+
+    const char* data() const { return address; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    std::string_view view() const { return std::string_view(address, length); }
+
+private:
+    const char* address = nullptr;
+    size_t length = 0;
+#ifndef FSU_POSIX
+    std::string fallback;
+#endif
+
+    void unmap() {
+    #ifdef FSU_POSIX
+        if (address) ::munmap(const_cast<char*>(address), length);
+    #endif
+        address = nullptr;
+        length = 0;
+    }
+};
+
+/**
+ * @brief How writeFile() commits data to disk.
+ */
+enum class WriteMode {
+    Fast,     ///< Truncate and write in place; no sync.
+    Durable,  ///< Write in place, then fdatasync the file and fsync its directory.
+    Atomic    ///< Write a temp file beside the target, fdatasync, rename over it, fsync the directory.
+};
+
+namespace detail {
+
+/// Per-thread generator for unique names.
+inline std::mt19937_64& randomEngine() {
+    thread_local std::mt19937_64 engine(std::random_device{}() ^ std::hash<std::thread::id>()(std::this_thread::get_id()));
+    return engine;
+}
+
+#ifdef FSU_POSIX
+inline bool syncData(int fd) {
+#if defined(__APPLE__)
+    return ::fcntl(fd, F_FULLFSYNC) == 0 || ::fsync(fd) == 0;
+#else
+    return ::fdatasync(fd) == 0;
+#endif
+}
+
+inline bool syncDirectory(const fs::path& dir, std::error_code& ec) {
+    UniqueFd fd(::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (!fd || ::fsync(fd.get()) != 0) {
+        ec = lastError();
+        return false;
+    }
+    return true;
+}
+
+/// Writes every buffer with as few writev() calls as possible.
+inline bool writeAll(int fd, const std::vector<std::string_view>& buffers, std::error_code& ec) {
+    std::vector<struct iovec> iov;
+    iov.reserve(buffers.size());
+    for (auto buffer : buffers) {
+        if (!buffer.empty()) iov.push_back({const_cast<char*>(buffer.data()), buffer.size()});
+    }
+    size_t first = 0;
+    while (first < iov.size()) {
+        int count = int(std::min<size_t>(iov.size() - first, IOV_MAX));
+        ssize_t n = ::writev(fd, &iov[first], count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ec = lastError();
+            return false;
+        }
+        size_t written = size_t(n);
+        while (first < iov.size() && written >= iov[first].iov_len) written -= iov[first++].iov_len;
+        if (written) {
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + written;
+            iov[first].iov_len -= written;
+        }
+    }
+    return true;
+}
+#endif // FSU_POSIX
+
+} // namespace detail
+
+namespace detail {
+
+/// prefix followed by 12 random base-36 characters.
+inline std::string uniqueName(const std::string& prefix) {
+    static constexpr char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    uint64_t bits = randomEngine()();
+    std::string name = prefix;
+    for (int i = 0; i < 12; ++i, bits /= 36) name += digits[bits % 36];
+    return name;
+}
+
+} // namespace detail
+
+/**
+ * @brief An exclusively created temporary file, deleted unless published.
+ *
+ * On Linux the file is created with O_TMPFILE and has no name at all until
+ * publish() links it into place, so a crash never leaves debris behind.
+ * Elsewhere, or on file systems without O_TMPFILE, it gets a random name
+ * opened with O_CREAT | O_EXCL, as mkstemp() does. Names come from a
+ * per-thread generator, so concurrent callers neither contend nor collide.
+ *
+ * @code
+ * std::error_code ec;
+ * fsu::TempFile temp(target.parent_path(), ec);
+ * if (!ec && temp.write(payload, ec) && temp.sync(ec)) temp.publish(target, ec);
+ * @endcode
+ */
+class TempFile {
+public:
+    TempFile() = default;
+
+    /**
+     * @brief Creates the file.
+     * @param dir Directory to create it in; publish() targets must be on the same file system.
+     * @param ec Set to the error on failure.
+     * @param prefix Start of the name used when the file needs one.
+     * @param permissions Mode bits, reduced by the umask.
+     */
+    TempFile(const fs::path& dir, std::error_code& ec, const std::string& prefix = "tmp", unsigned permissions = 0600)
+        : directory(dir.empty() ? fs::path(".") : dir), prefix(prefix) {
+        ec.clear();
+    #ifdef FSU_POSIX
+    #ifdef O_TMPFILE
+        fd.reset(::open(directory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, mode_t(permissions)));
+        if (fd) return;
+        if (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL && errno != ENOENT) {
+            ec = detail::lastError();
+            return;
+        }
+    #endif
+        for (int attempt = 0; attempt < 16; ++attempt) {
+            fs::path candidate = directory / detail::uniqueName(prefix);
+            fd.reset(::open(candidate.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, mode_t(permissions)));
+            if (fd) {
+                name = std::move(candidate);
+                return;
+            }
+            if (errno != EEXIST) break;
+        }
+        ec = detail::lastError();
+    #else
+        (void)permissions;
+        for (int attempt = 0; attempt < 16; ++attempt) {
+            fs::path candidate = directory / detail::uniqueName(prefix);
+            if (fs::exists(candidate, ec)) continue;
+            stream.open(candidate, std::ios::binary | std::ios::out);
+            if (stream) {
+                name = std::move(candidate);
+                return;
+            }
+            break;
+        }
+        ec = std::make_error_code(std::errc::file_exists);
+    #endif
+    }
+
+    ~TempFile() { discard(); }
+
+    TempFile(TempFile&&) = default;
+    TempFile& operator=(TempFile&& other) {
+        if (this != &other) {
+            discard();
+            directory = std::move(other.directory);
+            prefix = std::move(other.prefix);
+            name = std::move(other.name);
+        #ifdef FSU_POSIX
+            fd = std::move(other.fd);
+        #else
+            stream = std::move(other.stream);
+        #endif
+            other.name.clear();
+        }
+        return *this;
+    }
+
+    bool isOpen() const {
+    #ifdef FSU_POSIX
+        return bool(fd);
+    #else
+        return stream.is_open();
+    #endif
+    }
+
+    /// The file's name, empty while it is anonymous.
+    const fs::path& path() const { return name; }
+
+#ifdef FSU_POSIX
+    /// The open descriptor, for reading back or handing to other APIs.
+    int descriptor() const { return fd.get(); }
+#endif
+
+    /// Appends buffers with as few system calls as possible.
+    bool write(const std::vector<std::string_view>& buffers, std::error_code& ec) {
+        ec.clear();
+    #ifdef FSU_POSIX
+        return detail::writeAll(fd.get(), buffers, ec);
+    #else
+        for (auto buffer : buffers) stream.write(buffer.data(), std::streamsize(buffer.size()));
+        if (!stream.flush()) ec = std::make_error_code(std::errc::io_error);
+        return !ec;
+    #endif
+    }
+
+    bool write(std::string_view data, std::error_code& ec) { return write(std::vector<std::string_view>{data}, ec); }
+
+    /// Flushes the content to disk (fdatasync).
+    bool sync(std::error_code& ec) {
+        ec.clear();
+    #ifdef FSU_POSIX
+        if (!detail::syncData(fd.get())) ec = detail::lastError();
+    #else
+        if (!stream.flush()) ec = std::make_error_code(std::errc::io_error);
+    #endif
+        return !ec;
+    }
+
+    /**
+     * @brief Gives the file its final name, atomically replacing target.
+     *
+     * The file is closed and no longer deleted by the destructor. target
+     * must be on the same file system as the directory it was created in.
+     */
+    bool publish(const fs::path& target, std::error_code& ec) {
+        ec.clear();
+    #ifdef FSU_POSIX
+        if (name.empty()) {
+            // linkat() cannot replace an existing file: link under a fresh name, then rename over target.
+            std::string procPath = "/proc/self/fd/" + std::to_string(fd.get());
+            for (int attempt = 0; attempt < 16 && name.empty(); ++attempt) {
+                fs::path candidate = directory / detail::uniqueName(prefix);
+                int linked = ::linkat(AT_FDCWD, procPath.c_str(), AT_FDCWD, candidate.c_str(), AT_SYMLINK_FOLLOW);
+            #ifdef AT_EMPTY_PATH
+                if (linked != 0 && errno == ENOENT) linked = ::linkat(fd.get(), "", AT_FDCWD, candidate.c_str(), AT_EMPTY_PATH);
+            #endif
+                if (linked == 0) name = std::move(candidate);
+                else if (errno != EEXIST) break;
+            }
+            if (name.empty()) {
+                ec = detail::lastError();
+                return false;
+            }
+        }
+        if (::close(fd.release()) != 0 || ::rename(name.c_str(), target.c_str()) != 0) {
+            ec = detail::lastError();
+            return false;
+        }
+    #else
+        stream.close();
+        if (!stream) {
+            ec = std::make_error_code(std::errc::io_error);
+            return false;
+        }
+        fs::rename(name, target, ec);
+        if (ec) return false;
+    #endif
+        name.clear();
+        return true;
+    }
+
+private:
+    fs::path directory;
+    std::string prefix;
+    fs::path name;
+#ifdef FSU_POSIX
+    detail::UniqueFd fd;
+#else
+    std::ofstream stream;
+#endif
+
+    void discard() {
+    #ifdef FSU_POSIX
+        fd.reset();
+    #else
+        if (stream.is_open()) stream.close();
+    #endif
+        if (!name.empty()) {
+            std::error_code ec;
+            fs::remove(name, ec);
+            name.clear();
+        }
+    }
+};
+
+/**
+ * @brief Writes several buffers to a file as one, replacing its content.
+ *
+ * In Atomic mode readers see either the old or the new content, never a
+ * torn file, and the result survives a crash once the call returns; an
+ * existing target keeps its permission bits. The new content is staged
+ * in a TempFile, so an interrupted write leaves nothing behind. Durable
+ * mode syncs but can leave a partial file if interrupted. Fast mode only
+ * hands the data to the kernel.
+ *
+ * @param path The file path.
+ * @param buffers Pieces written back to back with writev().
+ * @param mode Durability guarantee.
+ * @param ec Set to the error on failure.
+ * @return true on success.
+ */
+inline bool writeFile(const fs::path& path, const std::vector<std::string_view>& buffers,
+                      WriteMode mode, std::error_code& ec) {
+    ec.clear();
+    if (mode == WriteMode::Atomic) {
+        TempFile temp(path.parent_path(), ec, "." + path.filename().string() + ".", 0666);
+        if (ec) return false;
+    #ifdef FSU_POSIX
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0) ::fchmod(temp.descriptor(), st.st_mode & 07777);
+        return temp.write(buffers, ec) && temp.sync(ec) && temp.publish(path, ec) &&
+               detail::syncDirectory(path.parent_path(), ec);
+    #else
+        return temp.write(buffers, ec) && temp.sync(ec) && temp.publish(path, ec);
+    #endif
+    }
+#ifdef FSU_POSIX
+    detail::UniqueFd fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666));
+    if (!fd) {
+        ec = detail::lastError();
+        return false;
+    }
+    if (!detail::writeAll(fd.get(), buffers, ec)) return false;
+    if (mode == WriteMode::Durable && !detail::syncData(fd.get())) {
+        ec = detail::lastError();
+        return false;
+    }
+    if (::close(fd.release()) != 0) {
+        ec = detail::lastError();
+        return false;
+    }
+    return mode == WriteMode::Fast || detail::syncDirectory(path.parent_path(), ec);
+#else
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    for (auto buffer : buffers) out.write(buffer.data(), std::streamsize(buffer.size()));
+    out.flush();
+    if (!out) {
+        ec = std::make_error_code(std::errc::io_error);
+        return false;
+    }
+    return true;
+#endif
+}
+
+/**
+ * @brief Writes a string to a file, replacing its content.
+ * @param path The file path.
+ * @param content The content to write.
+ * @param mode Durability guarantee, see WriteMode.
+ * @param ec Set to the error on failure.
+ * @return true on success.
+ */
+inline bool writeFile(const fs::path& path, std::string_view content, WriteMode mode, std::error_code& ec) {
+    return writeFile(path, std::vector<std::string_view>{content}, mode, ec);
+}
+
+/**
+ * @brief Writes a string to a file (overwrites).
+ * @param path The file path.
+ * @param content The content to write.
+ * @param mode Durability guarantee, see WriteMode.
+ * @return true on success.
+ */
+inline bool writeFile(const fs::path& path, const std::string& content, WriteMode mode = WriteMode::Fast) {
+    std::error_code ec;
+    if (!writeFile(path, std::string_view(content), mode, ec)) {
+        std::cerr << "Write failed: " << path << ": " << ec.message() << '\n';
+        return false;
+    }
+    return true;
+}
+
+namespace detail {
+
+#ifdef FSU_POSIX
+/**
+ * @brief Copies byte ranges between two descriptors, preferring kernel-side paths.
+ *
+ * Tries copy_file_range, then sendfile, then pread/pwrite, and remembers
+ * the first one that works so later ranges skip the failed attempts.
+ */
+class RangeCopier {
+public:
+    RangeCopier(int in, int out) : in(in), out(out) {}
+
+    bool copy(off_t offset, off_t length, std::error_code& ec) {
+        while (length > 0) {
+            size_t chunk = size_t(std::min<off_t>(length, off_t(1) << 30));
+            ssize_t n = -1;
+        #ifdef __linux__
+            if (method == CopyFileRange) {
+                loff_t inOffset = offset, outOffset = offset;
+                n = ::copy_file_range(in, &inOffset, out, &outOffset, chunk, 0);
+                if (n < 0 && unsupported(errno)) {
+                    method = SendFile;
+                    continue;
+                }
+            } else if (method == SendFile) {
+                off_t inOffset = offset;
+                if (::lseek(out, offset, SEEK_SET) < 0) n = -1;
+                else n = ::sendfile(out, in, &inOffset, chunk);
+                if (n < 0 && unsupported(errno)) {
+                    method = ReadWrite;
+                    continue;
+                }
+            } else
+        #endif
+            {
+                n = readWrite(offset, chunk);
+            }
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                ec = lastError();
+                return false;
+            }
+            if (n == 0) break;  // source shrank while copying
+            offset += n;
+            length -= n;
+        }
+        return true;
+    }
+
+private:
+    enum Method { CopyFileRange, SendFile, ReadWrite };
+    int in, out;
+#ifdef __linux__
+    Method method = CopyFileRange;
+#else
+    Method method = ReadWrite;
+#endif
+    std::unique_ptr<char[]> buffer;
+
+    static bool unsupported(int error) {
+        return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP || error == ENOTSUP;
+    }
+
+    ssize_t readWrite(off_t offset, size_t chunk) {
+        constexpr size_t BufferSize = 1 << 20;
+        if (!buffer) buffer.reset(new char[BufferSize]);
+        ssize_t n = ::pread(in, buffer.get(), std::min(chunk, BufferSize), offset);
+        for (ssize_t done = 0; n > 0 && done < n;) {
+            ssize_t w = ::pwrite(out, buffer.get() + done, size_t(n - done), offset + done);
+            if (w < 0 && errno != EINTR) return -1;
+            if (w > 0) done += w;
+        }
+        return n;
+    }
+};
+
+/// Copies the content of an open file; holes in sparse files stay holes.
+inline bool copyData(int in, int out, const struct stat& st, std::error_code& ec) {
+#ifdef FICLONE
+    if (::ioctl(out, FICLONE, in) == 0) return true;  // reflink: shares extents, no data moves
+#endif
+    RangeCopier copier(in, out);
+#ifdef SEEK_DATA
+    if (off_t(st.st_blocks) * 512 < st.st_size) {
+        off_t data = 0;
+        while ((data = ::lseek(in, data, SEEK_DATA)) >= 0) {
+            off_t hole = ::lseek(in, data, SEEK_HOLE);
+            if (hole < 0) hole = st.st_size;
+            if (!copier.copy(data, hole - data, ec)) return false;
+            data = hole;
+        }
+        if (errno != ENXIO) {
+            ec = lastError();
+            return false;
+        }
+        if (::ftruncate(out, st.st_size) != 0) {
+            ec = lastError();
+            return false;
+        }
+        return true;
+    }
+#endif
+    return copier.copy(0, st.st_size, ec);
+}
+#endif // FSU_POSIX
+
+} // namespace detail
+
+/**
+ * @brief Copies one regular file, replacing the destination.
+ *
+ * On Linux the data is cloned with FICLONE where the file system supports
+ * reflinks, otherwise copied in the kernel with copy_file_range or
+ * sendfile, and only as a last resort through a user-space buffer. Sparse
+ * files keep their holes. The permission bits are copied. Copying a file
+ * onto itself (or a hard link of itself) fails with file_exists and leaves
+ * it untouched.
+ *
+ * @param from Source file.
+ * @param to Destination file.
+ * @param ec Set to the error on failure.
+ * @return true on success.
+ */
+inline bool copyFile(const fs::path& from, const fs::path& to, std::error_code& ec) {
+    ec.clear();
+#ifdef FSU_POSIX
+    detail::UniqueFd in(::open(from.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat st;
+    if (!in || ::fstat(in.get(), &st) != 0) {
+        ec = detail::lastError();
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        ec = std::make_error_code(std::errc::invalid_argument);
+        return false;
+    }
+    // Truncate only once the destination is known not to be the source itself.
+    detail::UniqueFd out(::open(to.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, st.st_mode & 07777));
+    struct stat target;
+    if (!out || ::fstat(out.get(), &target) != 0) {
+        ec = detail::lastError();
+        return false;
+    }
+    if (target.st_dev == st.st_dev && target.st_ino == st.st_ino) {
+        ec = std::make_error_code(std::errc::file_exists);
+        return false;
+    }
+    if (::ftruncate(out.get(), 0) != 0) {
+        ec = detail::lastError();
+        return false;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(in.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    if (!detail::copyData(in.get(), out.get(), st, ec)) return false;
+    ::fchmod(out.get(), st.st_mode & 07777);
+    if (::close(out.release()) != 0) {
+        ec = detail::lastError();
+        return false;
+    }
+    return true;
+#else
+    return fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+#endif
+}
+
+/**
+ * @brief Options for copyTree().
+ */
+struct CopyOptions {
+    /// Files copied at once, 0 means one per hardware thread.
+    unsigned threads = 0;
+    /// Skips entries that already exist in the destination instead of replacing them.
+    bool skipExisting = false;
+};
+
+/**
+ * @brief Copies a directory tree in parallel.
+ *
+ * The source is walked with walk(), and every worker copies the files it
+ * lists with copyFile(), so at most CopyOptions::threads copies run at
+ * once. Directories are created before their content; symbolic links are
+ * recreated, not followed; other special files are skipped. An error on
+ * one entry is reported and the rest of the tree is still copied.
+ *
+ * @param from Source directory.
+ * @param to Destination directory, created if missing.
+ * @param options Concurrency and overwrite behaviour.
+ * @return true if every entry was copied.
+ */
+inline bool copyTree(const fs::path& from, const fs::path& to, const CopyOptions& options = {}) {
+    std::error_code ec;
+    fs::create_directories(to, ec);
+    if (ec) {
+        std::cerr << "Copy failed: " << to << ": " << ec.message() << '\n';
+        return false;
+    }
+    std::atomic<bool> ok{true};
+    WalkOptions walkOptions;
+    walkOptions.threads = options.threads;
+    bool walked = walk(from, [&](const DirEntry& entry) {
+        std::error_code error;
+        fs::path target = to / entry.path.lexically_relative(from);
+        if (options.skipExisting && entry.type != fs::file_type::directory && fs::symlink_status(target, error).type() != fs::file_type::not_found) {
+            return true;
+        }
+        switch (entry.type) {
+            case fs::file_type::directory:
+                fs::create_directory(target, error);
+                break;
+            case fs::file_type::regular:
+                copyFile(entry.path, target, error);
+                break;
+            case fs::file_type::symlink: {
+                fs::path link = fs::read_symlink(entry.path, error);
+                if (error) break;
+                fs::remove(target, error);
+                fs::create_symlink(link, target, error);
+                break;
+            }
+            default:
+                break;
+        }
+        if (error) {
+            std::cerr << "Copy failed: " << entry.path << ": " << error.message() << '\n';
+            ok = false;
+        }
+        return true;
+    }, walkOptions);
+    return walked && ok;
+}
+
+/**
+ * @brief Copies a file or directory to a new location.
+ *
+ * Files go through copyFile(); a recursive directory copy through
+ * copyTree(). Copying a file onto an existing directory places it inside.
+ *
+ * @param from Source path.
+ * @param to Destination path.
+ * @param recursive If true, performs recursive copy.
+ * @return true if copy was successful.
+ */
+inline bool copy(const fs::path& from, const fs::path& to, bool recursive = false) {
+    try {
+        if (fs::is_directory(from)) {
+            if (recursive) return copyTree(from, to);
+            fs::copy(from, to, fs::copy_options::overwrite_existing);
+            return true;
+        }
+        std::error_code ec;
+        fs::path target = fs::is_directory(to) ? to / from.filename() : to;
+        if (!copyFile(from, target, ec)) {
+            std::cerr << "Copy failed: " << from << ": " << ec.message() << '\n';
+            return false;
+        }
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Copy failed: " << e.what() << '\n';
+        return false;
+    }
+}
+
+/**
+ * @brief Options for removeTree() and removeAsync().
+ */
+struct RemoveOptions {
+    /// Workers deleting at once, 0 means one per hardware thread.
+    unsigned threads = 0;
+    /// removeAsync() moves the tree here first; empty means beside the original. Must be on the same file system.
+    fs::path trash;
+};
+
+/**
+ * @brief Deletes a directory tree in parallel.
+ *
+ * Workers list directories with the getdents64 reader and delete entries
+ * with unlinkat() relative to the open directory, so no path is resolved
+ * twice. A directory is removed by the worker that finishes its last
+ * child. Symbolic links are deleted, never followed. A path that is not
+ * a directory is simply unlinked.
+ *
+ * @param path Tree to delete.
+ * @param options Worker count.
+ * @return true if everything was deleted.
+ */
+inline bool removeTree(const fs::path& path, const RemoveOptions& options = {}) {
+#ifdef FSU_POSIX
+    struct Node {
+        std::shared_ptr<Node> parent;
+        std::shared_ptr<detail::DirReader> reader;  // stays open until the children are gone
+        fs::path path;
+        std::atomic<int> pending{1};  // the listing itself plus one per subdirectory
+    };
+    using Task = std::shared_ptr<Node>;
+
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0) {
+        std::cerr << "Delete failed: " << path << ": " << std::strerror(errno) << '\n';
+        return false;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        if (::unlink(path.c_str()) == 0) return true;
+        std::cerr << "Delete failed: " << path << ": " << std::strerror(errno) << '\n';
+        return false;
+    }
+
+    std::atomic<bool> ok{true};
+    auto report = [&](const fs::path& failed) {
+        std::cerr << "Delete failed: " << failed << ": " << std::strerror(errno) << '\n';
+        ok = false;
+    };
+    // Drops one reference; the last one removes the directory and walks up.
+    auto release = [&](Node* node) {
+        while (node && node->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Node* parent = node->parent.get();
+            node->reader.reset();
+            int dirfd = parent ? parent->reader->fd() : AT_FDCWD;
+            fs::path name = parent ? node->path.filename() : node->path;
+            if (::unlinkat(dirfd, name.c_str(), AT_REMOVEDIR) != 0) report(node->path);
+            node = parent;
+        }
+    };
+
+    auto root = std::make_shared<Node>();
+    root->path = path;
+    detail::WorkStealingPool<Task> pool(options.threads);
+    pool.run({root}, [&](Task& node, unsigned worker) {
+        int parentFd = node->parent ? node->parent->reader->fd() : AT_FDCWD;
+        fs::path name = node->parent ? node->path.filename() : node->path;
+        node->reader = detail::DirReader::open(parentFd, name.c_str());
+        if (!node->reader) {
+            report(node->path);
+            // Leave the parent non-empty rather than retrying; release without removing.
+            for (Node* up = node->parent.get(); up; up = up->parent.get()) {
+                if (up->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) break;
+                up->reader.reset();
+            }
+            return;
+        }
+        std::string_view entry;
+        fs::file_type type;
+        std::string entryName;
+        while (node->reader->next(entry, type)) {
+            if (type == fs::file_type::directory) {
+                auto child = std::make_shared<Node>();
+                child->parent = node;
+                child->path = node->path / entry;
+                node->pending.fetch_add(1, std::memory_order_relaxed);
+                pool.spawn(worker, std::move(child));
+                continue;
+            }
+            entryName.assign(entry);
+            if (::unlinkat(node->reader->fd(), entryName.c_str(), 0) != 0 && errno != ENOENT) report(node->path / entry);
+        }
+        release(node.get());
+    });
+    return ok;
+#else
+    (void)options;
+    std::error_code ec;
+    if (fs::remove_all(path, ec) == 0 && !ec) ec = std::make_error_code(std::errc::no_such_file_or_directory);
+    if (ec) {
+        std::cerr << "Delete failed: " << path << ": " << ec.message() << '\n';
+        return false;
+    }
+    return true;
+#endif
+}
+
+/**
+ * @brief Deletes a tree in the background.
+ *
+ * The tree is first renamed to a unique name in RemoveOptions::trash (or
+ * beside the original), so the path is free as soon as this returns; the
+ * actual deletion runs with removeTree() on a detached thread. If the
+ * rename is not possible the tree is deleted in place. Dropping the future
+ * does not wait for the deletion; a process that exits first leaves the
+ * rest of the renamed tree behind.
+ *
+ * @param path Tree to delete.
+ * @param options Worker count and trash location.
+ * @return Future that becomes true once everything was deleted.
+ */
+[[nodiscard]] inline std::future<bool> removeAsync(const fs::path& path, const RemoveOptions& options = {}) {
+    fs::path victim = path;
+    fs::path trashDir = options.trash.empty() ? path.parent_path() : options.trash;
+    for (int attempt = 0; attempt < 16; ++attempt) {
+        fs::path candidate = trashDir / detail::uniqueName("." + path.filename().string() + ".deleting.");
+        std::error_code ec;
+        if (fs::exists(candidate, ec)) continue;
+        fs::rename(path, candidate, ec);
+        if (!ec) victim = candidate;
+        break;
+    }
+    // Not std::async: its future would block in the destructor until the deletion finished.
+    std::promise<bool> promise;
+    std::future<bool> result = promise.get_future();
+    std::thread([victim, options, promise = std::move(promise)]() mutable {
+        try {
+            promise.set_value(removeTree(victim, options));
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+    }).detach();
+    return result;
+}
+
+/**
+ * @brief Deletes a file or directory (recursively).
+ *
+ * Directories are deleted in parallel with removeTree().
+ *
+ * @param path The path to delete.
+ * @return true if deletion was successful.
+ */
+inline bool remove(const fs::path& path) {
+    std::error_code ec;
+    if (!fs::exists(fs::symlink_status(path, ec))) return false;
+    return removeTree(path);
+}
+
+/**
+ * @brief Outcome of one IoBatch operation.
+ */
+struct IoResult {
+    std::error_code ec;                         ///< Empty on success.
+    std::string data;                           ///< File content, for read.
+    size_t bytes = 0;                           ///< Bytes transferred, for read and write.
+    fs::file_type type = fs::file_type::none;   ///< File type, for stat.
+    uintmax_t size = 0;                         ///< File size, for stat.
+};
+
+namespace detail {
+
+#ifdef FSU_IO_URING
+/**
+ * @brief Minimal io_uring ring set up through the raw system calls.
+ */
+class IoUring {
+public:
+    explicit IoUring(unsigned depth) {
+        io_uring_params params{};
+        ringFd = int(::syscall(__NR_io_uring_setup, depth, &params));
+        if (ringFd < 0) return;
+        if (!(params.features & IORING_FEAT_NODROP) || !supportsOps()) {
+            reset();
+            return;
+        }
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        cqRing = single ? sqRing
+                        : ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        sqeSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqeMap = ::mmap(nullptr, sqeSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqeMap == MAP_FAILED) {
+            if (sqeMap != MAP_FAILED) ::munmap(sqeMap, sqeSize);
+            reset();
+            return;
+        }
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        sqes = static_cast<io_uring_sqe*>(sqeMap);
+        entries = params.sq_entries;
+        localTail = *sqTail;
+    }
+
+    ~IoUring() {
+        if (sqes) ::munmap(sqes, sqeSize);
+        reset();
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    bool valid() const { return sqes != nullptr; }
+    unsigned size() const { return entries; }
+
+    /// Returns a zeroed submission entry, or nullptr if the queue is full.
+    io_uring_sqe* acquire() {
+        if (localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= entries) return nullptr;
+        unsigned index = localTail++ & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        return sqe;
+    }
+
+    /**
+     * Submits queued entries and waits for at least waitFor completions.
+     * Returns 0 without waiting when the kernel pushes back (EAGAIN, EBUSY),
+     * so the caller can reap completions before submitting again.
+     */
+    int submit(unsigned waitFor) {
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+        for (;;) {
+            unsigned pending = localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+            long n = ::syscall(__NR_io_uring_enter, ringFd, pending, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (n >= 0 || errno == EAGAIN || errno == EBUSY) return 0;
+            if (errno != EINTR) return -errno;
+        }
+    }
+
+    /// Calls onCompletion(userData, result) for every available completion.
+    template <class F>
+    void drain(F&& onCompletion) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            uint64_t userData = cqe.user_data;
+            int result = cqe.res;
+            __atomic_store_n(cqHead, ++head, __ATOMIC_RELEASE);
+            onCompletion(userData, result);
+            tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        }
+    }
+
+private:
+    int ringFd = -1;
+    void* sqRing = MAP_FAILED;
+    void* cqRing = MAP_FAILED;
+    size_t sqRingSize = 0, cqRingSize = 0, sqeSize = 0;
+    unsigned *sqHead = nullptr, *sqTail = nullptr, *sqArray = nullptr, *cqHead = nullptr, *cqTail = nullptr;
+    unsigned sqMask = 0, cqMask = 0, entries = 0, localTail = 0;
+    io_uring_cqe* cqes = nullptr;
+    io_uring_sqe* sqes = nullptr;
+
+    bool supportsOps() {
+        constexpr unsigned count = 256;
+        std::vector<char> storage(sizeof(io_uring_probe) + count * sizeof(io_uring_probe_op));
+        auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (::syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, count) < 0) return false;
+        for (int op : {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE, IORING_OP_UNLINKAT}) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+        }
+        return true;
+    }
+
+    void reset() {
+        if (cqRing != MAP_FAILED && cqRing != sqRing) ::munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) ::munmap(sqRing, sqRingSize);
+        sqRing = cqRing = MAP_FAILED;
+        sqes = nullptr;
+        if (ringFd >= 0) ::close(ringFd);
+        ringFd = -1;
+    }
+};
+#endif // FSU_IO_URING
+
+} // namespace detail
+
+/**
+ * @brief Runs many small file operations as one batch.
+ *
+ * Operations are queued with read(), write(), stat() and unlink() and
+ * executed by run(). On Linux they go through an io_uring ring, so a
+ * whole batch costs a handful of system calls; each operation is a short
+ * chain (open, read, close) driven by its completions. Where io_uring is
+ * missing or lacks the needed opcodes, the batch runs on a thread pool
+ * with the synchronous calls.
+ *
+ * Callbacks run on the thread that calls run() and may queue further
+ * operations, which the same run() completes. Overloads without a callback
+ * return a future that is ready once run() has processed the operation.
+ *
+ * @code
+ * fsu::IoBatch batch;
+ * for (const auto& path : paths) {
+ *     batch.read(path, [](const fs::path& p, fsu::IoResult& r) { if (!r.ec) index(p, r.data); });
+ * }
+ * batch.run();
+ * @endcode
+ */
+class IoBatch {
+public:
+    using Callback = std::function<void(const fs::path&, IoResult&)>;
+
+    /**
+     * @param queueDepth Operations in flight at once.
+     * @param forceThreadPool Skip io_uring even where it is available.
+     */
+    explicit IoBatch(unsigned queueDepth = 256, bool forceThreadPool = false) {
+    #ifdef FSU_IO_URING
+        if (!forceThreadPool) {
+            ring = std::make_unique<detail::IoUring>(std::max(queueDepth, 2u) * 2);
+            if (!ring->valid()) ring.reset();
+        }
+    #else
+        (void)queueDepth;
+        (void)forceThreadPool;
+    #endif
+    }
+
+    /// True if operations are executed through io_uring.
+    bool usesIoUring() const {
+    #ifdef FSU_IO_URING
+        return ring != nullptr;
+    #else
+        return false;
+    #endif
+    }
+
+    /// Reads a whole file into IoResult::data.
+    void read(const fs::path& path, Callback done) { enqueue(Kind::Read, path, std::string(), std::move(done)); }
+    /// Replaces a file's content with data (no sync, like WriteMode::Fast).
+    void write(const fs::path& path, std::string data, Callback done) { enqueue(Kind::Write, path, std::move(data), std::move(done)); }
+    /// Fills IoResult::type and IoResult::size, following symlinks.
+    void stat(const fs::path& path, Callback done) { enqueue(Kind::Stat, path, std::string(), std::move(done)); }
+    /// Removes a file.
+    void unlink(const fs::path& path, Callback done) { enqueue(Kind::Unlink, path, std::string(), std::move(done)); }
+
+    std::future<IoResult> read(const fs::path& path) { return withFuture(Kind::Read, path, std::string()); }
+    std::future<IoResult> write(const fs::path& path, std::string data) { return withFuture(Kind::Write, path, std::move(data)); }
+    std::future<IoResult> stat(const fs::path& path) { return withFuture(Kind::Stat, path, std::string()); }
+    std::future<IoResult> unlink(const fs::path& path) { return withFuture(Kind::Unlink, path, std::string()); }
+
+    /// Executes every queued operation and invokes its callback.
+    void run() {
+    #ifdef FSU_IO_URING
+        if (ring) runRing();
+        else runPool();
+    #else
+        runPool();
+    #endif
+        ops.clear();
+    }
+
+private:
+    enum class Kind { Read, Write, Stat, Unlink };
+    enum Stage : uint64_t { Open, Statx, Transfer, Close };
+
+    struct Op {
+        Kind kind;
+        fs::path path;
+        std::string input;
+        Callback done;
+        IoResult result;
+        int fd = -1;
+        unsigned pending = 0;
+        size_t offset = 0;
+    #ifdef FSU_IO_URING
+        struct statx info {};
+    #endif
+    };
+
+    std::deque<Op> ops;  // a deque keeps addresses stable while callbacks queue more
+#ifdef FSU_IO_URING
+    std::unique_ptr<detail::IoUring> ring;
+    std::deque<std::pair<size_t, Stage>> deferred;  // no submission entry was free
+    size_t issued = 0;                               // entries whose completion is outstanding
+#endif
+
+    void enqueue(Kind kind, const fs::path& path, std::string data, Callback done) {
+        Op op;
+        op.kind = kind;
+        op.path = path;
+        op.input = std::move(data);
+        op.done = std::move(done);
+        ops.push_back(std::move(op));
+    }
+
+    std::future<IoResult> withFuture(Kind kind, const fs::path& path, std::string data) {
+        auto promise = std::make_shared<std::promise<IoResult>>();
+        auto future = promise->get_future();
+        enqueue(kind, path, std::move(data), [promise](const fs::path&, IoResult& result) {
+            promise->set_value(std::move(result));
+        });
+        return future;
+    }
+
+    static void finish(Op& op) {
+        if (op.done) op.done(op.path, op.result);
+    }
+
+    static void execute(Op& op) {
+        IoResult& r = op.result;
+        switch (op.kind) {
+            case Kind::Read:
+                r.data = readFile(op.path, r.ec);
+                r.bytes = r.data.size();
+                break;
+            case Kind::Write:
+                if (writeFile(op.path, std::string_view(op.input), WriteMode::Fast, r.ec)) r.bytes = op.input.size();
+                break;
+            case Kind::Stat: {
+                fs::file_status status = fs::status(op.path, r.ec);
+                if (!r.ec && !fs::exists(status)) r.ec = std::make_error_code(std::errc::no_such_file_or_directory);
+                if (r.ec) break;
+                r.type = status.type();
+                if (r.type == fs::file_type::regular) r.size = fs::file_size(op.path, r.ec);
+                break;
+            }
+            case Kind::Unlink:
+            #ifdef FSU_POSIX
+                if (::unlink(op.path.c_str()) != 0) r.ec = detail::lastError();
+            #else
+                if (!fs::remove(op.path, r.ec) && !r.ec) r.ec = std::make_error_code(std::errc::no_such_file_or_directory);
+            #endif
+                break;
+        }
+    }
+
+    void runPool() {
+        size_t begin = 0;
+        while (begin < ops.size()) {
+            size_t end = ops.size();
+            std::vector<size_t> indices;
+            for (size_t i = begin; i < end; ++i) indices.push_back(i);
+            detail::WorkStealingPool<size_t> pool(unsigned(std::min<size_t>(end - begin, std::max(1u, std::thread::hardware_concurrency()) * 2)));
+            pool.run(std::move(indices), [this](size_t& index, unsigned) { execute(ops[index]); });
+            for (size_t i = begin; i < end; ++i) finish(ops[i]);
+            begin = end;
+        }
+    }
+
+#ifdef FSU_IO_URING
+    static uint64_t tag(size_t index, Stage stage) { return uint64_t(index) << 2 | stage; }
+
+    void prepare(size_t index, Stage stage) {
+        ++ops[index].pending;
+        io_uring_sqe* sqe = ring->acquire();
+        if (!sqe && ring->submit(0) == 0) sqe = ring->acquire();
+        if (sqe) fill(sqe, index, stage);
+        else deferred.emplace_back(index, stage);  // runRing retries after reaping
+    }
+
+    void fill(io_uring_sqe* sqe, size_t index, Stage stage) {
+        Op& op = ops[index];
+        sqe->user_data = tag(index, stage);
+        ++issued;
+        switch (stage) {
+            case Open:
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = uint64_t(uintptr_t(op.path.c_str()));
+                if (op.kind == Kind::Read) {
+                    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+                } else {
+                    sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+                    sqe->len = 0666;
+                }
+                break;
+            case Statx:
+                sqe->opcode = IORING_OP_STATX;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = uint64_t(uintptr_t(op.path.c_str()));
+                sqe->len = STATX_TYPE | STATX_SIZE;
+                sqe->off = uint64_t(uintptr_t(&op.info));
+                break;
+            case Transfer:
+                if (op.kind == Kind::Read) {
+                    sqe->opcode = IORING_OP_READ;
+                    sqe->addr = uint64_t(uintptr_t(&op.result.data[op.offset]));
+                    sqe->len = unsigned(std::min<size_t>(op.result.data.size() - op.offset, 1u << 30));
+                } else {
+                    sqe->opcode = IORING_OP_WRITE;
+                    sqe->addr = uint64_t(uintptr_t(op.input.data() + op.offset));
+                    sqe->len = unsigned(std::min<size_t>(op.input.size() - op.offset, 1u << 30));
+                }
+                sqe->fd = op.fd;
+                sqe->off = op.offset;
+                break;
+            case Close:
+                if (op.kind == Kind::Unlink) {
+                    sqe->opcode = IORING_OP_UNLINKAT;
+                    sqe->fd = AT_FDCWD;
+                    sqe->addr = uint64_t(uintptr_t(op.path.c_str()));
+                } else {
+                    sqe->opcode = IORING_OP_CLOSE;
+                    sqe->fd = op.fd;
+                }
+                break;
+        }
+    }
+
+    void start(size_t index) {
+        switch (ops[index].kind) {
+            case Kind::Read:
+                prepare(index, Open);
+                prepare(index, Statx);
+                break;
+            case Kind::Write: prepare(index, Open); break;
+            case Kind::Stat: prepare(index, Statx); break;
+            case Kind::Unlink: prepare(index, Close); break;
+        }
+    }
+
+    void fail(Op& op, int result) {
+        if (!op.result.ec) op.result.ec = std::error_code(-result, std::generic_category());
+    }
+
+    /// Advances an operation; returns true when it is complete.
+    bool advance(size_t index, Stage stage, int result) {
+        Op& op = ops[index];
+        --op.pending;
+        switch (stage) {
+            case Open:
+                if (result < 0) fail(op, result);
+                else op.fd = result;
+                break;
+            case Statx:
+                if (result < 0) {
+                    fail(op, result);
+                } else {
+                    op.result.type = detail::fromMode(op.info.stx_mode);
+                    op.result.size = op.info.stx_size;
+                }
+                break;
+            case Transfer:
+                if (result < 0) {
+                    fail(op, result);
+                    break;
+                }
+                op.offset += size_t(result);
+                if (op.kind == Kind::Write) {
+                    if (op.offset < op.input.size() && result > 0) {
+                        prepare(index, Transfer);
+                        return false;
+                    }
+                    op.result.bytes = op.offset;
+                    break;
+                }
+                if (result > 0) {
+                    if (op.offset == op.result.data.size()) op.result.data.resize(op.result.data.size() * 2);
+                    prepare(index, Transfer);
+                    return false;
+                }
+                op.result.data.resize(op.offset);
+                op.result.bytes = op.offset;
+                break;
+            case Close:
+                if (result < 0) fail(op, result);
+                op.fd = -1;
+                return op.pending == 0;
+        }
+        if (op.pending) return false;
+        if (op.fd >= 0 && (op.result.ec || stage == Transfer)) {
+            prepare(index, Close);
+            return false;
+        }
+        if (op.fd >= 0) {
+            // Opened (and sized) successfully: start the transfer.
+            if (op.kind == Kind::Read) {
+                bool sized = op.result.type == fs::file_type::regular && op.result.size > 0;
+                op.result.data.resize(sized ? size_t(op.result.size) + 1 : 64 * 1024);
+                op.result.type = fs::file_type::none;
+                op.result.size = 0;
+            }
+            prepare(index, Transfer);
+            return false;
+        }
+        return true;
+    }
+
+    void runRing() {
+        const size_t maxInFlight = ring->size() / 2;
+        size_t next = 0, inFlight = 0;
+        while (next < ops.size() || inFlight) {
+            while (!deferred.empty()) {
+                io_uring_sqe* sqe = ring->acquire();
+                if (!sqe) break;
+                fill(sqe, deferred.front().first, deferred.front().second);
+                deferred.pop_front();
+            }
+            while (deferred.empty() && next < ops.size() && inFlight < maxInFlight) {
+                start(next++);
+                ++inFlight;
+            }
+            if (int error = ring->submit(issued ? 1 : 0); error < 0) {
+                // The ring is unusable: fail what is in flight and finish the rest on threads.
+                std::cerr << "io_uring submission failed: " << std::strerror(-error) << '\n';
+                ring.reset();
+                deferred.clear();
+                issued = 0;
+                for (size_t i = 0; i < next; ++i) {
+                    Op& op = ops[i];
+                    if (!op.pending) continue;
+                    fail(op, error);
+                    if (op.fd >= 0) ::close(op.fd);
+                    finish(op);
+                }
+                ops.erase(ops.begin(), ops.begin() + std::ptrdiff_t(next));
+                runPool();
+                return;
+            }
+            ring->drain([&](uint64_t userData, int result) {
+                --issued;
+                size_t index = size_t(userData >> 2);
+                if (advance(index, Stage(userData & 3), result)) {
+                    --inFlight;
+                    finish(ops[index]);
+                }
+            });
+        }
+    }
+#endif // FSU_IO_URING
+};
+
+/**
+ * @brief Reads many files in one IoBatch.
+ * @param paths Files to read.
+ * @param errors If given, receives one error code per path.
+ * @return File contents in the order of paths; empty where a read failed.
+ */
+inline std::vector<std::string> readFiles(const std::vector<fs::path>& paths, std::vector<std::error_code>* errors = nullptr) {
+    std::vector<std::string> contents(paths.size());
+    if (errors) errors->assign(paths.size(), std::error_code());
+    IoBatch batch;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        batch.read(paths[i], [&, i](const fs::path&, IoResult& result) {
+            contents[i] = std::move(result.data);
+            if (errors) (*errors)[i] = result.ec;
+        });
+    }
+    batch.run();
+    return contents;
+}
+
+/**
+ * @brief Streaming XXH64, a fast non-cryptographic 64-bit hash.
+ *
+ * Produces the same values as the reference xxHash implementation, so
+ * digests can be compared with other tools. It detects accidental changes,
+ * not deliberate tampering.
+ */
+class Hash64 {
+public:
+    explicit Hash64(uint64_t seed = 0)
+        : v{seed + P1 + P2, seed + P2, seed, seed - P1}, seed(seed) {}
+
+    Hash64& update(const void* data, size_t length) {
+        auto* p = static_cast<const unsigned char*>(data);
+        const unsigned char* end = p + length;
+        total += length;
+        if (buffered + length < 32) {
+            std::memcpy(buffer + buffered, p, length);
+            buffered += length;
+            return *this;
+        }
+        if (buffered) {
+            size_t fill = 32 - buffered;
+            std::memcpy(buffer + buffered, p, fill);
+            consume(buffer);
+            p += fill;
+            buffered = 0;
+        }
+        for (; p + 32 <= end; p += 32) consume(p);
+        buffered = size_t(end - p);
+        std::memcpy(buffer, p, buffered);
+        return *this;
+    }
+
+    Hash64& update(std::string_view data) { return update(data.data(), data.size()); }
+
+    uint64_t digest() const {
+        uint64_t h;
+        if (total >= 32) {
+            h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+            for (uint64_t lane : v) h = (h ^ round(0, lane)) * P1 + P4;
+        } else {
+            h = seed + P5;
+        }
+        h += total;
+        const unsigned char* p = buffer;
+        const unsigned char* end = buffer + buffered;
+        for (; p + 8 <= end; p += 8) h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+        if (p + 4 <= end) {
+            h = rotl(h ^ read32(p) * P1, 23) * P2 + P3;
+            p += 4;
+        }
+        for (; p < end; ++p) h = rotl(h ^ *p * P5, 11) * P1;
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static constexpr uint64_t P1 = 11400714785074694791ULL;
+    static constexpr uint64_t P2 = 14029467366897019727ULL;
+    static constexpr uint64_t P3 = 1609587929392839161ULL;
+    static constexpr uint64_t P4 = 9650029242287828579ULL;
+    static constexpr uint64_t P5 = 2870177450012600261ULL;
+
+    uint64_t v[4];
+    uint64_t seed;
+    uint64_t total = 0;
+    unsigned char buffer[32];
+    size_t buffered = 0;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+    static uint64_t round(uint64_t acc, uint64_t input) { return rotl(acc + input * P2, 31) * P1; }
+    static uint64_t read64(const unsigned char* p) {
+        uint64_t x;
+        std::memcpy(&x, p, sizeof(x));
+    #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        x = __builtin_bswap64(x);
+    #endif
+        return x;
+    }
+    static uint64_t read32(const unsigned char* p) {
+        uint32_t x;
+        std::memcpy(&x, p, sizeof(x));
+    #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        x = __builtin_bswap32(x);
+    #endif
+        return x;
+    }
+
+    void consume(const unsigned char* p) {
+        for (int i = 0; i < 4; ++i) v[i] = round(v[i], read64(p + 8 * i));
+    }
+};
+
+/**
+ * @brief Hashes a file's content with Hash64.
+ * @param path The file path.
+ * @param ec Set to the error on failure.
+ * @return The XXH64 digest (seed 0), 0 on failure.
+ */
+inline uint64_t hashFile(const fs::path& path, std::error_code& ec) {
+    ec.clear();
+    Hash64 hash;
+#ifdef FSU_POSIX
+    detail::UniqueFd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd) {
+        ec = detail::lastError();
+        return 0;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(fd.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    constexpr size_t BufferSize = 1 << 20;
+    std::unique_ptr<char[]> buffer(new char[BufferSize]);
+    for (;;) {
+        ssize_t n = ::read(fd.get(), buffer.get(), BufferSize);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ec = detail::lastError();
+            return 0;
+        }
+        if (n == 0) break;
+        hash.update(buffer.get(), size_t(n));
+    }
+#else
+    std::string content = readFile(path, ec);
+    if (ec) return 0;
+    hash.update(content);
+#endif
+    return hash.digest();
+}
+
+/**
+ * @brief Metadata and content hash of one file in a HashIndex.
+ */
+struct FileRecord {
+    uint64_t size = 0;
+    int64_t mtime = 0;   ///< Modification time in nanoseconds since the epoch.
+    uint64_t inode = 0;
+    uint64_t hash = 0;   ///< XXH64 of the content.
+};
+
+namespace detail {
+
+inline bool fileRecord(const fs::path& path, FileRecord& record, std::error_code& ec) {
+#ifdef FSU_POSIX
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0) {
+        ec = lastError();
+        return false;
+    }
+    record.size = uint64_t(st.st_size);
+    record.inode = uint64_t(st.st_ino);
+#if defined(__APPLE__)
+    record.mtime = int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    record.mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#else
+    record.size = fs::file_size(path, ec);
+    if (ec) return false;
+    record.mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(fs::last_write_time(path, ec).time_since_epoch()).count();
+    record.inode = 0;
+    if (ec) return false;
+#endif
+    return true;
+}
+
+} // namespace detail
+
+/**
+ * @brief Content hashes of a directory tree, updated incrementally.
+ *
+ * scan() walks the tree in parallel and re-hashes only files whose size,
+ * modification time or inode changed since the previous scan; the rest
+ * keep their recorded hash. Files modified in the same instant as a scan
+ * are re-hashed on the next one, since a later write could share their
+ * timestamp. Paths are stored relative to the scanned root, so an index
+ * stays valid when the tree is moved. save() and load() persist the index
+ * in a compact binary file, written atomically.
+ *
+ * @code
+ * fsu::HashIndex index;
+ * index.load(".cache/tree.idx");
+ * auto changes = index.scan("assets");
+ * for (const auto& path : changes.modified) rebuild(path);
+ * index.save(".cache/tree.idx");
+ * @endcode
+ */
+class HashIndex {
+public:
+    /// Outcome of scan(); paths are relative to the scanned root.
+    struct Changes {
+        std::vector<fs::path> added;
+        std::vector<fs::path> modified;
+        std::vector<fs::path> removed;
+        size_t unchanged = 0;
+        uintmax_t bytesHashed = 0;
+        bool ok = true;  ///< false if some files or directories could not be read
+    };
+
+    /**
+     * @brief Brings the index up to date with the tree under root.
+     *
+     * A file that cannot be hashed keeps its previous record. If any
+     * directory cannot be read, files not seen are kept as well instead
+     * of being reported removed, so a missing root leaves the index as is.
+     *
+     * @param root Directory to scan.
+     * @param threads Workers, 0 means one per hardware thread.
+     * @return What changed since the previous scan.
+     */
+    Changes scan(const fs::path& root, unsigned threads = 0) {
+        Changes changes;
+        std::unordered_map<std::string, FileRecord> next;
+        std::mutex mutex;
+        int64_t started = int64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+        std::atomic<bool> failed{false};
+        // Carries a record over unverified; one that was still racy is
+        // marked so the next scan hashes it again.
+        auto keep = [&](const std::string& key) {
+            auto previous = records.find(key);
+            if (previous == records.end()) return;
+            FileRecord kept = previous->second;
+            if (kept.mtime >= scanTime) kept.mtime = -1;
+            next.emplace(key, kept);
+        };
+        WalkOptions options;
+        options.threads = threads;
+        bool walked = walk(root, [&](const DirEntry& entry) {
+            if (entry.type != fs::file_type::regular) return true;
+            std::string key = entry.path.lexically_relative(root).generic_string();
+            FileRecord record;
+            std::error_code ec;
+            if (!detail::fileRecord(entry.path, record, ec)) {
+                std::cerr << "Hashing failed: " << entry.path << ": " << ec.message() << '\n';
+                failed = true;
+                std::lock_guard<std::mutex> lock(mutex);
+                keep(key);
+                return true;
+            }
+            auto previous = records.find(key);
+            bool known = previous != records.end();
+            bool same = known && previous->second.size == record.size && previous->second.mtime == record.mtime &&
+                        previous->second.inode == record.inode && previous->second.mtime < scanTime;
+            if (same) {
+                record.hash = previous->second.hash;
+            } else {
+                record.hash = hashFile(entry.path, ec);
+                if (ec) {
+                    std::cerr << "Hashing failed: " << entry.path << ": " << ec.message() << '\n';
+                    failed = true;
+                    std::lock_guard<std::mutex> lock(mutex);
+                    keep(key);
+                    return true;
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!known) changes.added.push_back(key);
+            else if (record.hash != previous->second.hash) changes.modified.push_back(key);
+            else ++changes.unchanged;
+            if (!same) changes.bytesHashed += record.size;
+            next.emplace(std::move(key), record);
+            return true;
+        }, options);
+        changes.ok = walked && !failed;
+        for (const auto& old : records) {
+            if (next.count(old.first)) continue;
+            if (walked) changes.removed.push_back(old.first);
+            else keep(old.first);
+        }
+        records = std::move(next);
+        scanTime = started;
+        return changes;
+    }
+
+    /// The record for a path relative to the scanned root, or nullptr.
+    const FileRecord* find(const fs::path& relative) const {
+        auto it = records.find(relative.generic_string());
+        return it != records.end() ? &it->second : nullptr;
+    }
+
+    size_t size() const { return records.size(); }
+    const std::unordered_map<std::string, FileRecord>& entries() const { return records; }
+
+    /**
+     * @brief Writes the index to a file atomically.
+     * @return true on success.
+     */
+    bool save(const fs::path& file) const {
+        std::string out(Magic, sizeof(Magic));
+        put(out, uint64_t(scanTime));
+        put(out, uint64_t(records.size()));
+        for (const auto& entry : records) {
+            put(out, entry.second.size);
+            put(out, uint64_t(entry.second.mtime));
+            put(out, entry.second.inode);
+            put(out, entry.second.hash);
+            put(out, uint64_t(entry.first.size()));
+            out += entry.first;
+        }
+        return writeFile(file, out, WriteMode::Atomic);
+    }
+
+    /**
+     * @brief Replaces the index with one saved by save().
+     * @return false (leaving the index empty) if the file is missing or corrupt.
+     */
+    bool load(const fs::path& file) {
+        records.clear();
+        scanTime = 0;
+        std::error_code ec;
+        std::string in = readFile(file, ec);
+        size_t pos = sizeof(Magic);
+        uint64_t time, count;
+        if (ec || in.compare(0, sizeof(Magic), Magic, sizeof(Magic)) != 0 || !get(in, pos, time) || !get(in, pos, count)) {
+            return false;
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            FileRecord record;
+            uint64_t mtime, length;
+            if (!get(in, pos, record.size) || !get(in, pos, mtime) || !get(in, pos, record.inode) ||
+                !get(in, pos, record.hash) || !get(in, pos, length) || in.size() - pos < length) {
+                records.clear();
+                return false;
+            }
+            record.mtime = int64_t(mtime);
+            records.emplace(in.substr(pos, length), record);
+            pos += length;
+        }
+        scanTime = int64_t(time);
+        return true;
+    }
+
+private:
+    static constexpr char Magic[8] = {'F', 'S', 'U', 'H', 'I', 'D', 'X', '1'};
+    std::unordered_map<std::string, FileRecord> records;
+    int64_t scanTime = 0;
+
+    static void put(std::string& out, uint64_t value) {
+        for (int i = 0; i < 8; ++i) out += char(value >> (8 * i));
+    }
+    static bool get(const std::string& in, size_t& pos, uint64_t& value) {
+        if (in.size() < pos + 8) return false;
+        value = 0;
+        for (int i = 7; i >= 0; --i) value = value << 8 | uint64_t(static_cast<unsigned char>(in[pos + size_t(i)]));
+        pos += 8;
+        return true;
+    }
+};
+
+/**
+ * @brief Generates a unique temporary file name.
+ *
+ * Only a name is returned, so another process may still take it before
+ * it is used; prefer TempFile, which creates the file atomically.
+ *
  * @param prefix Optional prefix string.
  * @return Path to a unique (non-existing) temp file.
  */
 inline fs::path generateTempFile(const std::string& prefix = "tmp") {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(100000, 999999);
-
     fs::path tempDir = fs::temp_directory_path();
     fs::path candidate;
+    std::error_code ec;
 
     do {
-        candidate = tempDir / (prefix + std::to_string(dis(gen)));
-    } while (fs::exists(candidate));
+        candidate = tempDir / detail::uniqueName(prefix);
+    } while (fs::exists(candidate, ec));
 
     return candidate;
 }
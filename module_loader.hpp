@@ -2,14 +2,68 @@
 #define MODULE_LOADER_HPP
 
 #include <string>
+#include <algorithm>
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <tuple>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
 
 #ifdef _WIN32
     #include <windows.h>
 #else
     #include <dlfcn.h>
+    #include <sys/statvfs.h>
+    #include <unistd.h>
 #endif
 
+/**
+ * @brief Declares one entry of a module function table.
+ *
+ * A table is a struct of function pointers with a static symbols()
+ * function returning a tuple of these entries:
+ *
+ * @code
+ * struct MathApi {
+ *     double (*cos)(double);
+ *     double (*sqrt)(double);
+ *
+ *     static constexpr auto symbols() {
+ *         return std::make_tuple(ModuleSymbol("cos", &MathApi::cos),
+ *                                ModuleSymbol("sqrt", &MathApi::sqrt, "double(double)"));
+ *     }
+ * };
+ * @endcode
+ *
+ * If a signature is given, the module must also export a string named
+ * `<name>_signature` with the same text (see MODULE_EXPORT_SIGNATURE).
+ *
+ * @tparam Table The table struct.
+ * @tparam F Type of the member receiving the symbol.
+ */
+template <typename Table, typename F>
+struct ModuleSymbol {
+    const char* name;
+    F Table::* member;
+    const char* signature;
+
+    constexpr ModuleSymbol(const char* symbolName, F Table::* target, const char* expectedSignature = nullptr)
+        : name(symbolName), member(target), signature(expectedSignature) {}
+};
+
+/**
+ * @brief Exports the signature string checked by ModuleSymbol from inside a module.
+ *
+ * Example: MODULE_EXPORT_SIGNATURE(scale, "double(double)")
+ */
+#define MODULE_EXPORT_SIGNATURE(symbol, text) extern "C" const char symbol##_signature[] = text
+
 /**
  * @class ModuleLoader
  * @brief Cross-platform dynamic module (shared library) loader.
@@ -118,23 +172,90 @@ public:
      * @brief Retrieves a symbol (function or variable) from the loaded module.
      *
      * You must know the correct type for the symbol you are retrieving.
+     * Each call is a fresh lookup; resolve hot functions once with bind().
      *
      * @tparam T Function pointer or variable type.
      * @param name Name of the exported symbol.
      * @return Pointer to the symbol, or nullptr if not found or module is not loaded.
      */
     template<typename T>
-    T getSymbol(const std::string& name) const {
+    T getSymbol(const char* name) const {
         if (!handle) return nullptr;
 
     #ifdef _WIN32
-        return reinterpret_cast<T>(GetProcAddress((HMODULE)handle, name.c_str()));
+        return reinterpret_cast<T>(GetProcAddress((HMODULE)handle, name));
     #else
-        return reinterpret_cast<T>(dlsym(handle, name.c_str()));
+        return reinterpret_cast<T>(dlsym(handle, name));
     #endif
     }
 
+    template<typename T>
+    T getSymbol(const std::string& name) const {
+        return getSymbol<T>(name.c_str());
+    }
+
+    /**
+     * @brief Resolves every symbol declared by Table::symbols() into table.
+     *
+     * All symbols are looked up, and every missing one or signature
+     * mismatch is reported; table is only written if all of them resolve.
+     * Calls through the table then cost one indirect call.
+     *
+     * @tparam Table Struct of function pointers, see ModuleSymbol.
+     * @param table Receives the resolved pointers.
+     * @return true if every symbol was found and matched.
+     */
+    template<typename Table>
+    bool bind(Table& table) const {
+        if (!handle) return false;
+        Table resolved{};
+        bool ok = true;
+        std::apply([&](const auto&... symbol) { ((ok = bindSymbol(resolved, symbol) && ok), ...); }, Table::symbols());
+        if (ok) table = resolved;
+        return ok;
+    }
+
+    /**
+     * @brief Loads a module and binds its function table.
+     *
+     * A module that lacks any declared symbol is rejected at load time,
+     * instead of failing at the first call.
+     *
+     * @param path Filesystem path to the shared library.
+     * @param table Receives the resolved pointers.
+     * @return true if the module was loaded and every symbol resolved.
+     */
+    template<typename Table>
+    bool load(const std::string& path, Table& table) {
+        if (!load(path)) return false;
+        if (!bind(table)) {
+            std::cerr << "Module rejected: " << path << "\n";
+            unload();
+            return false;
+        }
+        return true;
+    }
+
 private:
+    template<typename Table, typename F>
+    bool bindSymbol(Table& table, const ModuleSymbol<Table, F>& symbol) const {
+        void* address = getSymbol<void*>(symbol.name);
+        if (!address) {
+            std::cerr << "Missing symbol: " << symbol.name << "\n";
+            return false;
+        }
+        if (symbol.signature) {
+            const char* exported = getSymbol<const char*>(std::string(symbol.name) + "_signature");
+            if (!exported || std::strcmp(exported, symbol.signature) != 0) {
+                std::cerr << "Signature mismatch for symbol " << symbol.name << ": expected " << symbol.signature
+                          << ", module has " << (exported ? exported : "none") << "\n";
+                return false;
+            }
+        }
+        table.*symbol.member = reinterpret_cast<F>(address);
+        return true;
+    }
+
 #ifdef _WIN32
     HMODULE handle = nullptr;  ///< Windows handle to the loaded module.
 #else
@@ -142,6 +263,312 @@ private:
 #endif
 };
 
+namespace module_loader_detail {
+
+/// Hands out small per-thread indices, recycled when threads exit.
+class ReaderIndex {
+public:
+    ReaderIndex() {
+        std::lock_guard<std::mutex> lock(mutex());
+        if (!freeList().empty()) {
+            value = freeList().back();
+            freeList().pop_back();
+        } else {
+            value = next()++;
+        }
+    }
+    ~ReaderIndex() {
+        std::lock_guard<std::mutex> lock(mutex());
+        freeList().push_back(value);
+    }
+    unsigned value;
+
+private:
+    static std::mutex& mutex() { static std::mutex m; return m; }
+    static std::vector<unsigned>& freeList() { static std::vector<unsigned> list; return list; }
+    static unsigned& next() { static unsigned n = 0; return n; }
+};
+
+inline unsigned readerIndex() {
+    thread_local ReaderIndex index;
+    return index.value;
+}
+
+/// Loaders this thread entered through the shared overflow counter.
+inline std::vector<const void*>& overflowGuards() {
+    thread_local std::vector<const void*> held;
+    return held;
+}
+
+} // namespace module_loader_detail
+
+/**
+ * @class HotModuleLoader
+ * @brief Reloads a module while other threads keep calling into it.
+ *
+ * reload() loads and binds the new version next to the running one, then
+ * swaps the table pointer atomically; calls that started before the swap
+ * finish in the old code, later calls see the new one. The old version is
+ * closed only after every thread has left it, detected with epochs: each
+ * reader thread owns a cache-line sized slot where it announces the epoch
+ * it entered in, and reload() waits until no slot shows an older one.
+ *
+ * Entering and leaving a guard is a few atomic loads and stores on the
+ * caller's own slot, with no loops or locks, so dispatch is wait-free.
+ * Guards may nest. Threads beyond MaxReaders share an overflow counter;
+ * they stay correct but can delay reload() under constant traffic.
+ *
+ * reload() must not be called by a thread that holds a Guard of the same
+ * loader: it would wait for itself forever, so it aborts instead.
+ *
+ * dlopen() hands back the already loaded image when asked for the same
+ * file again, so reloading the current path goes through a hidden copy
+ * of the library. The copy goes next to the original; if that directory
+ * is read-only it goes into a private directory under $XDG_RUNTIME_DIR,
+ * the temp directory or ~/.cache, whichever is not mounted noexec.
+ *
+ * @tparam Table Function table, see ModuleSymbol.
+ * @tparam MaxReaders Threads with a dedicated slot.
+ */
+template <typename Table, unsigned MaxReaders = 256>
+class HotModuleLoader {
+    struct Version {
+        ModuleLoader module;
+        Table table{};
+    };
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{0};  // 0 while the thread is outside every guard
+        unsigned depth = 0;              // touched only by the owning thread
+    };
+
+public:
+    /**
+     * @brief Keeps the current version alive while it is in scope.
+     */
+    class Guard {
+    public:
+        Guard(Guard&& other) noexcept : owner(other.owner), slot(other.slot), version(other.version) {
+            other.owner = nullptr;
+        }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        Guard& operator=(Guard&&) = delete;
+        ~Guard() { if (owner) owner->exit(slot); }
+
+        explicit operator bool() const { return version != nullptr; }
+        const Table& operator*() const { return version->table; }
+        const Table* operator->() const { return &version->table; }
+
+    private:
+        friend class HotModuleLoader;
+        Guard(const HotModuleLoader* loader, Slot* readerSlot, const Version* current)
+            : owner(loader), slot(readerSlot), version(current) {}
+        const HotModuleLoader* owner;
+        Slot* slot;
+        const Version* version;
+    };
+
+    HotModuleLoader() : slots(new Slot[MaxReaders]) {}
+
+    /**
+     * @brief Constructor that immediately attempts to load a module.
+     * @param path Filesystem path to the shared library.
+     */
+    explicit HotModuleLoader(const std::string& path) : HotModuleLoader() {
+        reload(path);
+    }
+
+    /**
+     * @brief Destructor. No thread may hold a Guard any more.
+     */
+    ~HotModuleLoader() {
+        delete current.load();
+    }
+
+    HotModuleLoader(const HotModuleLoader&) = delete;
+    HotModuleLoader& operator=(const HotModuleLoader&) = delete;
+
+    /**
+     * @brief Loads a module (again) and switches callers over to it.
+     *
+     * The running version keeps serving if the new one cannot be loaded
+     * or lacks a symbol. Blocks until the previous version is drained and
+     * closed; concurrent reloads are serialized. Aborts if the calling
+     * thread holds a Guard, since that version could never be drained.
+     *
+     * @param path Filesystem path to the shared library.
+     * @return true if the new version is active.
+     */
+    bool reload(const std::string& path) {
+        if (holdsGuard()) {
+            std::cerr << "HotModuleLoader: reload from a thread holding a Guard\n";
+            std::abort();
+        }
+        std::lock_guard<std::mutex> lock(writer);
+        auto next = std::make_unique<Version>();
+        std::filesystem::path loadPath = path;
+        bool copied = false;
+        if (current.load() && path == loadedPath) {
+            loadPath = privateCopy(path);
+            copied = !loadPath.empty();
+            if (!copied) return false;
+        }
+        bool ok = next->module.load(loadPath.string(), next->table);
+    #ifndef _WIN32
+        // A mapped library stays usable after its file is unlinked.
+        if (copied) discardCopy(loadPath);
+    #endif
+        if (!ok) return false;
+        loadedPath = path;
+        Version* old = current.exchange(next.release());
+        synchronize();
+        delete old;
+        return true;
+    }
+
+    /**
+     * @brief Checks whether a module is currently loaded.
+     */
+    bool isLoaded() const {
+        return current.load(std::memory_order_acquire) != nullptr;
+    }
+
+    /**
+     * @brief Pins the current version for the lifetime of the returned guard.
+     * @return Guard that converts to false if nothing is loaded.
+     */
+    Guard acquire() const {
+        Slot* slot = enter();
+        return Guard(this, slot, current.load());
+    }
+
+    /**
+     * @brief Calls one function of the current version.
+     *
+     * @param function Member of Table to call, e.g. &Api::process.
+     * @param args Arguments forwarded to it.
+     * @return Whatever the function returns.
+     */
+    template <typename R, typename... Params, typename... Args>
+    R call(R (*Table::* function)(Params...), Args&&... args) const {
+        Guard guard = acquire();
+        if (!guard) {
+            std::cerr << "HotModuleLoader: call without a loaded module\n";
+            std::abort();
+        }
+        return ((*guard).*function)(std::forward<Args>(args)...);
+    }
+
+private:
+    std::atomic<Version*> current{nullptr};
+    std::atomic<uint64_t> epoch{1};
+    std::unique_ptr<Slot[]> slots;
+    mutable std::atomic<unsigned> overflow{0};
+    std::mutex writer;
+    std::string loadedPath;
+
+    Slot* enter() const {
+        unsigned index = module_loader_detail::readerIndex();
+        if (index >= MaxReaders) {
+            overflow.fetch_add(1);
+            module_loader_detail::overflowGuards().push_back(this);
+            return nullptr;
+        }
+        Slot& slot = slots[index];
+        // Announce the epoch before reading the table pointer (both seq_cst), so
+        // synchronize() either sees this reader or this reader sees the new table.
+        if (slot.depth++ == 0) slot.epoch.store(epoch.load());
+        return &slot;
+    }
+
+    void exit(Slot* slot) const {
+        if (!slot) {
+            auto& held = module_loader_detail::overflowGuards();
+            held.erase(std::find(held.rbegin(), held.rend(), this).base() - 1);
+            overflow.fetch_sub(1, std::memory_order_release);
+        } else if (--slot->depth == 0) {
+            slot->epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    bool holdsGuard() const {
+        unsigned index = module_loader_detail::readerIndex();
+        if (index < MaxReaders) return slots[index].depth != 0;
+        const auto& held = module_loader_detail::overflowGuards();
+        return std::find(held.begin(), held.end(), this) != held.end();
+    }
+
+    /// Waits until no reader can still hold a table published before this call.
+    void synchronize() {
+        uint64_t target = epoch.fetch_add(1) + 1;
+        for (unsigned i = 0; i < MaxReaders; ++i) {
+            for (;;) {
+                uint64_t seen = slots[i].epoch.load();
+                if (seen == 0 || seen >= target) break;
+                std::this_thread::yield();
+            }
+        }
+        while (overflow.load() != 0) std::this_thread::yield();
+    }
+
+    static std::filesystem::path privateCopy(const std::string& path) {
+        std::filesystem::path source = path;
+        std::filesystem::path beside = source.parent_path().empty() ? "." : source.parent_path();
+        thread_local std::mt19937_64 random(std::random_device{}());
+        std::string name = "." + source.stem().string() + "." + std::to_string(random()) + source.extension().string();
+        std::error_code ec;
+        std::filesystem::path copy = beside / name;
+        if (writable(beside) && std::filesystem::copy_file(source, copy, ec)) return copy;
+
+        std::vector<std::filesystem::path> fallbacks;
+        if (const char* runtime = std::getenv("XDG_RUNTIME_DIR")) fallbacks.push_back(runtime);
+        fallbacks.push_back(std::filesystem::temp_directory_path(ec));
+        if (const char* home = std::getenv("HOME")) fallbacks.push_back(std::filesystem::path(home) / ".cache");
+        for (const auto& base : fallbacks) {
+            if (base.empty()) continue;
+            std::filesystem::create_directories(base, ec);  // ~/.cache may not exist yet
+            if (!writable(base) || !executable(base)) continue;
+            std::filesystem::path dir = base / (".hotmodule." + std::to_string(random()));
+            if (!std::filesystem::create_directory(dir, ec)) continue;
+            std::filesystem::permissions(dir, std::filesystem::perms::owner_all, ec);
+            copy = dir / name;
+            if (!ec && std::filesystem::copy_file(source, copy, ec)) return copy;
+            std::filesystem::remove(dir, ec);
+        }
+        std::cerr << "Failed to copy module for reload: " << path << "\nError: "
+                  << (ec ? ec.message() : "no writable directory allows executables") << "\n";
+        return {};
+    }
+
+    static void discardCopy(const std::filesystem::path& copy) {
+        std::error_code ec;
+        std::filesystem::remove(copy, ec);
+        if (copy.parent_path().filename().string().rfind(".hotmodule.", 0) == 0) {
+            std::filesystem::remove(copy.parent_path(), ec);
+        }
+    }
+
+    static bool writable(const std::filesystem::path& dir) {
+    #ifdef _WIN32
+        std::error_code ec;
+        return std::filesystem::is_directory(dir, ec);
+    #else
+        return ::access(dir.c_str(), W_OK | X_OK) == 0;
+    #endif
+    }
+
+    static bool executable(const std::filesystem::path& dir) {
+    #ifdef _WIN32
+        (void)dir;
+        return true;
+    #else
+        struct statvfs info;
+        return ::statvfs(dir.c_str(), &info) == 0 && !(info.f_flag & ST_NOEXEC);
+    #endif
+    }
+};
+
 #endif //MODULE_LOADER_HPP
 
 
@@ -174,6 +601,35 @@ int main() {
     double result = cosFunc(input);
     std::cout << "cos(" << input << ") = " << result << std::endl;
 
+    // Resolve a whole table once; the load fails if a symbol is missing
+    struct MathApi {
+        double (*sin)(double);
+        double (*pow)(double, double);
+
+        static constexpr auto symbols() {
+            return std::make_tuple(ModuleSymbol("sin", &MathApi::sin),
+                                   ModuleSymbol("pow", &MathApi::pow));
+        }
+    };
+
+    MathApi math;
+    ModuleLoader mathModule;
+    if (mathModule.load(libPath, math)) {
+        std::cout << "pow(2, 10) = " << math.pow(2, 10) << std::endl;
+    }
+
+    // Hot-swappable: other threads may call while reload() switches versions.
+    // Reloading the same path stages a copy beside it, so use a private one.
+    const char* hotPath = "./libm-hot.so.6";
+    std::filesystem::copy_file(libPath, hotPath, std::filesystem::copy_options::overwrite_existing);
+    HotModuleLoader<MathApi> hot(hotPath);
+    std::cout << "sin(0) = " << hot.call(&MathApi::sin, 0.0) << std::endl;
+    hot.reload(hotPath);
+    {
+        auto api = hot.acquire();  // pins one version for several calls
+        std::cout << "pow(3, 3) = " << api->pow(3, 3) << std::endl;
+    }
+
     return 0;
 }
 
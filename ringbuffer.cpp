@@ -1,4 +1,4 @@
-
+/*
 
                     Ring Buffer
                   Data Structure
@@ -10,14 +10,59 @@ A ring buffer is basically an array that loops end back to the beginning. It is
 
 Here is my own implementation of a ring buffer. There is a data stream that is being written into the buffer from the first thread. Then the data is being read from the buffer in the second thread. It all happens in parallel and a simple mutex is protecting the data structure.
 
+When many producers and many consumers share one buffer, the mutex serializes every operation. MPMCRingBuffer is a lock free variant in the style of Dmitry Vyukov's bounded queue: every slot carries a sequence number that tells producers when the slot is free and consumers when it is filled, so threads only contend on the head or tail counter they advance. It keeps the same push/pop interface.
+
+Bulk transfers do not have to pay the lock once per element: push_n/pop_n move a whole batch under one lock, and claimWrite/claimRead hand out the free or filled part of the array as up to two spans (two when the region wraps around the end). A producer can fill them in place, for instance with read() straight from a file descriptor, then make the data visible with commitWrite. The claim interface assumes a single producer (for claimWrite) and a single consumer (for claimRead).
+
+A failed push or pop returns immediately, so a thread that has nothing to do must retry. BlockingRingBuffer wraps any of the buffers and adds push_wait/pop_wait and the timed push_for/pop_for, which wait on a pluggable strategy: SpinWait keeps the core busy for the lowest latency, SpinYieldWait gives the core away after a short spin, FutexWait sleeps in the kernel (std::atomic::wait off Linux) and CondVarWait sleeps on a condition variable. An idle stage blocked on a sleeping strategy costs no cpu time.
+
+RingBuffer fixes its capacity at compile time, wraps with % and keeps cycle counters, and needs copyable elements. DynamicRingBuffer is a single producer single consumer variant sized at run time: the capacity is rounded up to a power of two so wrapping is a mask over monotonically increasing 64 bit indices that never need resetting. Elements are constructed in place with emplace, may be move only, and the storage is aligned to a cache line so it also suits SIMD loads.
+
+To fan one stream out to several consumers without one buffer (and one copy) per consumer, BroadcastRingBuffer lets one writer publish into a single ring while every subscribed Reader keeps its own cursor. In Overrun::gate mode the writer is held back by the slowest reader, and readers can look at the slot in place with peek/consume. In Overrun::lap mode the writer never waits: every slot carries the sequence number of the element in it, so a reader that fell a whole lap behind notices, skips ahead to the oldest element still in the ring and counts what it lost. Because a reader may copy a slot while the writer overwrites it, lap mode stores elements as relaxed atomic 64 bit words and needs trivially copyable types.
+
+The buffers above live inside one process: RingBuffer holds a std::mutex and its iterators point at their parent. ShmRingBuffer is a single producer single consumer ring laid out for a shm_open/mmap segment instead. It only stores indices, never pointers, so every process may map it at a different address. A header at the start of the segment records a magic number, the layout version, the capacity and the element size and alignment, and open() refuses a segment that does not match. Elements must be trivially copyable; with claimWrite/claimRead a producer process and a consumer process exchange records in place without the kernel copying them.
+
+Run with the argument "bench" to measure every buffer: throughput in operations per second for one producer and one consumer, four producers and one consumer, and four of each, over several element sizes and capacities, then round trip latency histograms, wait strategies, batching and broadcasting. It also sweeps the mutex and MPMC buffers from 1 to 32 threads on each side and times a ShmRingBuffer shared by a producer process and a consumer process. Threads are pinned to cores on Linux. Run with "stress" to check that every variant delivers all items, in order and without duplicates, including ShmRingBuffer across two processes; a run that stops making progress fails and reports how many items were lost. An optional second argument sets the number of items per run.
+
 */
 #include <iostream>
 #include <optional>
 #include <thread>
 #include <algorithm>
 #include <mutex>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <span>
+#include <array>
+#include <bit>
+#include <new>
+#include <memory>
+#include <cstring>
+#include <type_traits>
+#include <condition_variable>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <csignal>
+#include <unistd.h>
+#endif
 #define BUFFSIZE 20
 #define STREAMSIZE 200
+#define CACHELINE 64
 using namespace std;
 
 template <class T, size_t Size>
@@ -57,25 +102,30 @@ class RingBuffer{
             operator++();
             return temp;
         }
-        bool operator!=(const iterator& other){
+        bool operator!=(const iterator& other)const{
             return !operator==(other);
         }
-        bool operator==(iterator other){
+        bool operator==(iterator other)const{
             return (pos==other.pos&&cycle==other.cycle);
         }
-        bool operator<(iterator other){
+        bool operator<(iterator other)const{
             return pos+cycle*Size<other.pos+other.cycle*Size;
         }
-        bool operator<=(iterator other){
+        bool operator<=(iterator other)const{
             return pos+cycle*Size<=other.pos+other.cycle*Size;
         }
-        bool operator>(iterator other){
+        bool operator>(iterator other)const{
             return pos+cycle*Size>other.pos+other.cycle*Size;
         }
-        bool operator>=(iterator other){
+        bool operator>=(iterator other)const{
             return pos+cycle*Size>=other.pos+other.cycle*Size;
         }
     };
+    struct Regions{
+        span<T> first;
+        span<T> second;
+        size_t size()const{return first.size()+second.size();}
+    };
     T arr[Size]={};
     RingBuffer(){}
     bool push(T& value){
@@ -92,6 +142,42 @@ class RingBuffer{
         resetCycle();
         return {};
     }
+    size_t push_n(span<const T> values){
+        lock_guard<mutex>lock(mtx);
+        Regions r=regions(write.pos,min(values.size(),Size-used()));
+        copy_n(values.begin(),r.first.size(),r.first.begin());
+        copy_n(values.begin()+r.first.size(),r.second.size(),r.second.begin());
+        write=write+r.size();
+        return r.size();
+    }
+    size_t pop_n(span<T> values){
+        lock_guard<mutex>lock(mtx);
+        Regions r=regions(read.pos,min(values.size(),used()));
+        copy(r.first.begin(),r.first.end(),values.begin());
+        copy(r.second.begin(),r.second.end(),values.begin()+r.first.size());
+        read=read+r.size();
+        if(read==write) resetCycle();
+        return r.size();
+    }
+    //free slots for the producer to fill in place, published by commitWrite
+    Regions claimWrite(size_t n=Size){
+        lock_guard<mutex>lock(mtx);
+        return regions(write.pos,min(n,Size-used()));
+    }
+    void commitWrite(size_t n){
+        lock_guard<mutex>lock(mtx);
+        write=write+n;
+    }
+    //filled slots for the consumer to read in place, released by commitRead
+    Regions claimRead(size_t n=Size){
+        lock_guard<mutex>lock(mtx);
+        return regions(read.pos,min(n,used()));
+    }
+    void commitRead(size_t n){
+        lock_guard<mutex>lock(mtx);
+        read=read+n;
+        if(read==write) resetCycle();
+    }
     iterator begin(){return read;}
     iterator end(){return write;}
     private:
@@ -101,46 +187,1295 @@ class RingBuffer{
         read.cycle=0;
         write.cycle=0;
     }
+    size_t used()const{
+        return write.pos+write.cycle*Size-(read.pos+read.cycle*Size);
+    }
+    Regions regions(size_t pos,size_t n){
+        size_t first=min(n,Size-pos);
+        return {span<T>(arr+pos,first),span<T>(arr,n-first)};
+    }
 };
 
+template <class T, size_t Size>
+class MPMCRingBuffer{
+    static_assert(Size>=2,"MPMCRingBuffer needs at least two slots");
+    public:
+    MPMCRingBuffer(){
+        for(size_t i=0;i<Size;i++)
+            slots[i].seq.store(i,memory_order_relaxed);
+    }
+    bool push(T& value){
+        size_t pos=head.load(memory_order_relaxed);
+        for(;;){
+            Slot& slot=slots[pos%Size];
+            size_t seq=slot.seq.load(memory_order_acquire);
+            intptr_t dif=intptr_t(seq)-intptr_t(pos);
+            if(dif==0){
+                //slot is free for this lap, claim it by advancing head
+                if(head.compare_exchange_weak(pos,pos+1,memory_order_relaxed)){
+                    slot.value=value;
+                    slot.seq.store(pos+1,memory_order_release);
+                    return true;
+                }
+            }else if(dif<0) return false;//consumers have not freed it yet: full
+            else pos=head.load(memory_order_relaxed);//another producer got it
+        }
+    }
+    optional<T> pop(){
+        size_t pos=tail.load(memory_order_relaxed);
+        for(;;){
+            Slot& slot=slots[pos%Size];
+            size_t seq=slot.seq.load(memory_order_acquire);
+            intptr_t dif=intptr_t(seq)-intptr_t(pos+1);
+            if(dif==0){
+                if(tail.compare_exchange_weak(pos,pos+1,memory_order_relaxed)){
+                    optional<T> value{move(slot.value)};
+                    //hand the slot back to producers for the next lap
+                    slot.seq.store(pos+Size,memory_order_release);
+                    return value;
+                }
+            }else if(dif<0) return {};//not published yet: empty
+            else pos=tail.load(memory_order_relaxed);
+        }
+    }
+    size_t size()const{//approximate while other threads are running
+        size_t h=head.load(memory_order_relaxed);
+        size_t t=tail.load(memory_order_relaxed);
+        return h>t?h-t:0;
+    }
+    private:
+    struct Slot{
+        atomic<size_t> seq;
+        T value{};
+    };
+    Slot slots[Size];
+    alignas(CACHELINE) atomic<size_t> head{0};
+    alignas(CACHELINE) atomic<size_t> tail{0};
+};
 
-void writeToBuffer(RingBuffer<int,BUFFSIZE>& rb){
-    for(int i=0;i<STREAMSIZE;i++){
-        if(rb.push(i)) continue ;
-        i--;
+
+template <class T>
+class DynamicRingBuffer{
+    static constexpr size_t Align=max(alignof(T),size_t(CACHELINE));
+    public:
+    explicit DynamicRingBuffer(size_t capacity)
+        :mask{bit_ceil(max(capacity,size_t(2)))-1},
+         arr{static_cast<T*>(::operator new(sizeof(T)*(mask+1),align_val_t{Align}))}{}
+    DynamicRingBuffer(const DynamicRingBuffer&)=delete;
+    DynamicRingBuffer& operator=(const DynamicRingBuffer&)=delete;
+    ~DynamicRingBuffer(){
+        while(pop());
+        ::operator delete(arr,align_val_t{Align});
+    }
+    template <class... Args>
+    bool emplace(Args&&... args){
+        uint64_t w=write.load(memory_order_relaxed);
+        if(w-readCache>mask){
+            //only reload the consumer's index when the cached one says full
+            readCache=read.load(memory_order_acquire);
+            if(w-readCache>mask) return false;
+        }
+        new(arr+(w&mask)) T(forward<Args>(args)...);
+        write.store(w+1,memory_order_release);
+        return true;
+    }
+    bool push(const T& value) requires is_copy_constructible_v<T> {return emplace(value);}
+    bool push(T&& value){return emplace(move(value));}
+    optional<T> pop(){
+        uint64_t r=read.load(memory_order_relaxed);
+        if(r==writeCache){
+            writeCache=write.load(memory_order_acquire);
+            if(r==writeCache) return {};
+        }
+        T* slot=arr+(r&mask);
+        optional<T> value{move(*slot)};
+        slot->~T();
+        read.store(r+1,memory_order_release);
+        return value;
+    }
+    size_t capacity()const{return mask+1;}
+    size_t size()const{
+        return write.load(memory_order_acquire)-read.load(memory_order_acquire);
+    }
+    private:
+    const size_t mask;
+    T* const arr;
+    alignas(CACHELINE) atomic<uint64_t> write{0};
+    uint64_t readCache=0;//producer's copy of read
+    alignas(CACHELINE) atomic<uint64_t> read{0};
+    uint64_t writeCache=0;//consumer's copy of write
+};
+
+enum class Overrun{gate,lap};
+
+template <class T, size_t Size, Overrun Mode=Overrun::gate, size_t MaxReaders=16>
+class BroadcastRingBuffer{
+    static_assert(Mode==Overrun::gate||(is_trivially_copyable_v<T>&&atomic<uint64_t>::is_always_lock_free),
+                  "lapping readers copy slots word by word while they may be overwritten");
+    struct alignas(CACHELINE) Cursor{
+        atomic<uint64_t> pos{0};
+        atomic<bool> active{false};
+        uint64_t published=0;//reader's copy of the ring's published index
+        uint64_t lost=0;
+    };
+    public:
+    class Reader{
+        public:
+        Reader(Reader&& other):ring{other.ring},cursor{other.cursor}{other.cursor=nullptr;}
+        Reader(const Reader&)=delete;
+        Reader& operator=(const Reader&)=delete;
+        ~Reader(){
+            if(cursor) cursor->active.store(false,memory_order_release);
+        }
+        optional<T> pop(){
+            uint64_t r=cursor->pos.load(memory_order_relaxed);
+            for(;;){
+                if(!available(r)) return {};
+                if constexpr(Mode==Overrun::gate){
+                    optional<T> value{ring->slots[r%Size].value};
+                    cursor->pos.store(r+1,memory_order_release);
+                    return value;
+                }else{
+                    auto& slot=ring->slots[r%Size];
+                    uint64_t before=slot.seq.load(memory_order_acquire);
+                    T value=loadWords(slot);
+                    atomic_thread_fence(memory_order_acquire);
+                    if(before==r+1&&slot.seq.load(memory_order_relaxed)==before){
+                        cursor->pos.store(r+1,memory_order_relaxed);
+                        return value;
+                    }
+                    //lapped: resume at the oldest element the writer cannot reach soon
+                    uint64_t oldest=ring->published.load(memory_order_acquire)-Size/2;
+                    cursor->lost+=oldest-r;
+                    r=oldest;
+                    cursor->pos.store(r,memory_order_relaxed);
+                }
+            }
+        }
+        //zero copy access to the next element, valid until consume()
+        const T* peek() requires(Mode==Overrun::gate){
+            uint64_t r=cursor->pos.load(memory_order_relaxed);
+            return available(r)?&ring->slots[r%Size].value:nullptr;
+        }
+        void consume() requires(Mode==Overrun::gate){
+            cursor->pos.fetch_add(1,memory_order_release);
+        }
+        uint64_t lost()const{return cursor->lost;}
+        private:
+        friend class BroadcastRingBuffer;
+        BroadcastRingBuffer* ring;
+        Cursor* cursor;
+        Reader(BroadcastRingBuffer* rb,Cursor* c):ring{rb},cursor{c}{}
+        bool available(uint64_t r){
+            if(r<cursor->published) return true;
+            cursor->published=ring->published.load(memory_order_acquire);
+            return r<cursor->published;
+        }
+    };
+    //a reader starts at the next element published; nullopt when all cursors are taken
+    optional<Reader> subscribe(){
+        lock_guard<mutex>lock(gateMtx);
+        for(auto& c:cursors){
+            if(c.active.load(memory_order_acquire)) continue;
+            uint64_t start=published.load(memory_order_relaxed);
+            c.pos.store(start,memory_order_relaxed);
+            c.published=start;
+            c.lost=0;
+            c.active.store(true,memory_order_release);
+            return Reader(this,&c);
+        }
+        return {};
+    }
+    bool push(const T& value){
+        uint64_t w=published.load(memory_order_relaxed);
+        if constexpr(Mode==Overrun::gate){
+            if(w-slowest>=Size){
+                slowest=slowestReader(w);
+                if(w-slowest>=Size) return false;
+            }
+            slots[w%Size].value=value;
+        }else{
+            auto& slot=slots[w%Size];
+            slot.seq.store(0,memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);
+            storeWords(slot,value);
+            slot.seq.store(w+1,memory_order_release);
+        }
+        published.store(w+1,memory_order_release);
+        return true;
+    }
+    private:
+    struct GateSlot{
+        T value{};
+    };
+    //readers copy a slot while it may be rewritten, so every access is atomic
+    static constexpr size_t Words=(sizeof(T)+sizeof(uint64_t)-1)/sizeof(uint64_t);
+    struct LapSlot{
+        atomic<uint64_t> seq{0};//index+1 of the element inside
+        atomic<uint64_t> words[Words]{};
+    };
+    using Slot=conditional_t<Mode==Overrun::gate,GateSlot,LapSlot>;
+    Slot slots[Size];
+    static void storeWords(LapSlot& slot, const T& value){
+        uint64_t buf[Words]{};
+        memcpy(buf,&value,sizeof(T));
+        for(size_t i=0;i<Words;i++) slot.words[i].store(buf[i],memory_order_relaxed);
+    }
+    static T loadWords(const LapSlot& slot){
+        uint64_t buf[Words];
+        for(size_t i=0;i<Words;i++) buf[i]=slot.words[i].load(memory_order_relaxed);
+        T value;
+        memcpy(&value,buf,sizeof(T));
+        return value;
+    }
+    Cursor cursors[MaxReaders];
+    alignas(CACHELINE) atomic<uint64_t> published{0};
+    uint64_t slowest=0;//writer's cached gating position
+    mutex gateMtx;//only taken on subscribe and when the cached gate says full
+    uint64_t slowestReader(uint64_t w){
+        //holding the lock keeps a new subscriber from starting behind the gate
+        lock_guard<mutex>lock(gateMtx);
+        uint64_t low=w;
+        for(auto& c:cursors)
+            if(c.active.load(memory_order_acquire))
+                low=min(low,c.pos.load(memory_order_acquire));
+        return low;
+    }
+};
+
+#ifndef _WIN32
+struct ShmHeader{
+    static constexpr uint32_t MAGIC=0x52494e47;//"RING"
+    static constexpr uint32_t VERSION=1;
+    atomic<uint32_t> magic;//stored last by the creator
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t elementSize;
+    uint64_t elementAlign;
+    alignas(CACHELINE) atomic<uint64_t> write;
+    alignas(CACHELINE) atomic<uint64_t> read;
+};
+
+template <class T>
+class ShmRingBuffer{
+    static_assert(is_trivially_copyable_v<T>,"elements are shared as raw bytes");
+    static_assert(atomic<uint64_t>::is_always_lock_free,"indices must be address free");
+    static constexpr size_t SlotOffset=(sizeof(ShmHeader)+alignof(T)-1)/alignof(T)*alignof(T);
+    public:
+    struct Regions{
+        span<T> first;
+        span<T> second;
+        size_t size()const{return first.size()+second.size();}
+    };
+    //creates the named segment; capacity is rounded up to a power of two
+    static optional<ShmRingBuffer> create(const string& name, size_t capacity){
+        capacity=bit_ceil(max(capacity,size_t(2)));
+        size_t bytes=SlotOffset+capacity*sizeof(T);
+        int fd=shm_open(name.c_str(),O_CREAT|O_EXCL|O_RDWR,0600);
+        if(fd<0){
+            cerr<<"shm_open failed for "<<name<<endl;
+            return {};
+        }
+        if(ftruncate(fd,off_t(bytes))!=0){
+            cerr<<"ftruncate failed for "<<name<<endl;
+            close(fd);
+            shm_unlink(name.c_str());
+            return {};
+        }
+        void* base=map(fd,bytes);
+        if(!base){
+            shm_unlink(name.c_str());
+            return {};
+        }
+        ShmHeader* h=new(base) ShmHeader{};
+        h->version=ShmHeader::VERSION;
+        h->capacity=capacity;
+        h->elementSize=sizeof(T);
+        h->elementAlign=alignof(T);
+        h->magic.store(ShmHeader::MAGIC,memory_order_release);
+        return ShmRingBuffer(h,bytes);
+    }
+    //maps a segment made by create() in this or another process
+    static optional<ShmRingBuffer> open(const string& name){
+        int fd=shm_open(name.c_str(),O_RDWR,0);
+        if(fd<0){
+            cerr<<"shm_open failed for "<<name<<endl;
+            return {};
+        }
+        struct stat st;
+        if(fstat(fd,&st)!=0||size_t(st.st_size)<SlotOffset){
+            cerr<<"shared ring "<<name<<" is truncated"<<endl;
+            close(fd);
+            return {};
+        }
+        size_t bytes=size_t(st.st_size);
+        void* base=map(fd,bytes);
+        if(!base) return {};
+        ShmHeader* h=static_cast<ShmHeader*>(base);
+        if(h->magic.load(memory_order_acquire)!=ShmHeader::MAGIC
+           ||h->version!=ShmHeader::VERSION
+           ||h->elementSize!=sizeof(T)
+           ||h->elementAlign!=alignof(T)
+           ||!has_single_bit(h->capacity)
+           ||SlotOffset+h->capacity*sizeof(T)!=bytes){
+            cerr<<"shared ring "<<name<<" does not match this element type"<<endl;
+            munmap(base,bytes);
+            return {};
+        }
+        return ShmRingBuffer(h,bytes);
+    }
+    static void unlink(const string& name){shm_unlink(name.c_str());}
+    ShmRingBuffer(ShmRingBuffer&& other) noexcept
+        :header{other.header},bytes{other.bytes},mask{other.mask},arr{other.arr},
+         readCache{other.readCache},writeCache{other.writeCache}{
+        other.header=nullptr;
+    }
+    ShmRingBuffer(const ShmRingBuffer&)=delete;
+    ShmRingBuffer& operator=(const ShmRingBuffer&)=delete;
+    ShmRingBuffer& operator=(ShmRingBuffer&&)=delete;
+    ~ShmRingBuffer(){
+        if(header) munmap(header,bytes);
+    }
+    bool push(const T& value){
+        Regions r=claimWrite(1);
+        if(!r.size()) return false;
+        r.first[0]=value;
+        commitWrite(1);
+        return true;
+    }
+    optional<T> pop(){
+        Regions r=claimRead(1);
+        if(!r.size()) return {};
+        optional<T> value{r.first[0]};
+        commitRead(1);
+        return value;
+    }
+    Regions claimWrite(size_t n=SIZE_MAX){
+        uint64_t w=header->write.load(memory_order_relaxed);
+        if(n>mask+1-(w-readCache)) readCache=header->read.load(memory_order_acquire);
+        return regions(w,min<uint64_t>(n,mask+1-(w-readCache)));
+    }
+    void commitWrite(size_t n){
+        header->write.store(header->write.load(memory_order_relaxed)+n,memory_order_release);
+    }
+    Regions claimRead(size_t n=SIZE_MAX){
+        uint64_t r=header->read.load(memory_order_relaxed);
+        if(writeCache-r<n) writeCache=header->write.load(memory_order_acquire);
+        return regions(r,min<uint64_t>(n,writeCache-r));
+    }
+    void commitRead(size_t n){
+        header->read.store(header->read.load(memory_order_relaxed)+n,memory_order_release);
+    }
+    size_t capacity()const{return mask+1;}
+    private:
+    ShmHeader* header;
+    size_t bytes;
+    uint64_t mask;
+    T* arr;
+    uint64_t readCache=0;//producer's copy of read
+    uint64_t writeCache=0;//consumer's copy of write
+    ShmRingBuffer(ShmHeader* h,size_t b)
+        :header{h},bytes{b},mask{h->capacity-1},
+         arr{reinterpret_cast<T*>(reinterpret_cast<char*>(h)+SlotOffset)},
+         readCache{h->read.load(memory_order_acquire)},
+         writeCache{h->write.load(memory_order_acquire)}{}
+    static void* map(int fd,size_t bytes){
+        void* base=mmap(nullptr,bytes,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+        close(fd);
+        if(base==MAP_FAILED){
+            cerr<<"mmap of shared ring failed"<<endl;
+            return nullptr;
+        }
+        return base;
+    }
+    Regions regions(uint64_t index,size_t n){
+        size_t pos=index&mask;
+        size_t first=min(n,size_t(mask+1-pos));
+        return {span<T>(arr+pos,first),span<T>(arr,n-first)};
+    }
+};
+#endif
+
+using Deadline=chrono::steady_clock::time_point;
+constexpr Deadline forever=Deadline::max();
+
+inline void cpuRelax(){
+#if defined(__x86_64__)||defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+//Wait strategies: wait(ready,deadline) returns once ready() returns true, or
+//false when the deadline passes first. notify() is called after every state
+//change that could make a waiter's ready() succeed.
+struct SpinWait{
+    template <class Pred>
+    bool wait(Pred ready, Deadline deadline){
+        for(unsigned spins=0;!ready();spins++){
+            if(spins%256==255&&chrono::steady_clock::now()>=deadline) return false;
+            cpuRelax();
+        }
+        return true;
+    }
+    void notify(){}
+};
+
+struct SpinYieldWait{
+    template <class Pred>
+    bool wait(Pred ready, Deadline deadline){
+        for(unsigned spins=0;!ready();spins++){
+            if(spins<64){
+                cpuRelax();
+                continue;
+            }
+            if(chrono::steady_clock::now()>=deadline) return false;
+            this_thread::yield();
+        }
+        return true;
+    }
+    void notify(){}
+};
+
+class FutexWait{
+    public:
+    template <class Pred>
+    bool wait(Pred ready, Deadline deadline){
+        for(;;){
+            uint32_t seen=epoch.load(memory_order_acquire);
+            if(ready()) return true;
+            if(chrono::steady_clock::now()>=deadline) return false;
+            waiters.fetch_add(1,memory_order_seq_cst);
+            atomic_thread_fence(memory_order_seq_cst);
+            //a notify() that missed the increment happened before this check
+            if(ready()){
+                waiters.fetch_sub(1,memory_order_relaxed);
+                return true;
+            }
+            sleep(seen,deadline);
+            waiters.fetch_sub(1,memory_order_relaxed);
+        }
+    }
+    void notify(){
+        atomic_thread_fence(memory_order_seq_cst);
+        if(!waiters.load(memory_order_relaxed)) return;
+        epoch.fetch_add(1,memory_order_release);
+#ifdef __linux__
+        syscall(SYS_futex,&epoch,FUTEX_WAKE_PRIVATE,INT_MAX,nullptr,nullptr,0);
+#else
+        epoch.notify_all();
+#endif
+    }
+    private:
+    atomic<uint32_t> epoch{0};
+    atomic<uint32_t> waiters{0};
+    void sleep(uint32_t seen, Deadline deadline){
+#ifdef __linux__
+        timespec ts,*timeout=nullptr;
+        if(deadline!=forever){
+            auto left=chrono::duration_cast<chrono::nanoseconds>(deadline-chrono::steady_clock::now());
+            if(left.count()<=0) return;
+            ts.tv_sec=left.count()/1000000000;
+            ts.tv_nsec=left.count()%1000000000;
+            timeout=&ts;
+        }
+        syscall(SYS_futex,&epoch,FUTEX_WAIT_PRIVATE,seen,timeout,nullptr,0);
+#else
+        if(deadline==forever) epoch.wait(seen,memory_order_acquire);
+        else this_thread::yield();//atomic::wait has no timed form
+#endif
+    }
+};
+
+class CondVarWait{
+    public:
+    template <class Pred>
+    bool wait(Pred ready, Deadline deadline){
+        unique_lock<mutex>lock(mtx);
+        waiters.fetch_add(1,memory_order_seq_cst);
+        atomic_thread_fence(memory_order_seq_cst);
+        bool done=true;
+        while(!ready()){
+            if(deadline==forever) cv.wait(lock);
+            else if(cv.wait_until(lock,deadline)==cv_status::timeout){
+                done=ready();
+                break;
+            }
+        }
+        waiters.fetch_sub(1,memory_order_relaxed);
+        return done;
+    }
+    void notify(){
+        atomic_thread_fence(memory_order_seq_cst);
+        if(!waiters.load(memory_order_relaxed)) return;
+        //taking the lock means a waiter is either before its check or asleep
+        lock_guard<mutex>lock(mtx);
+        cv.notify_all();
+    }
+    private:
+    mutex mtx;
+    condition_variable cv;
+    atomic<uint32_t> waiters{0};
+};
+
+template <class Buffer, class Wait=SpinYieldWait>
+class BlockingRingBuffer: public Buffer{
+    public:
+    using T=typename decltype(declval<Buffer&>().pop())::value_type;
+    bool push(T& value){
+        if(!Buffer::push(value)) return false;
+        notEmpty.notify();
+        return true;
+    }
+    optional<T> pop(){
+        optional<T> value=Buffer::pop();
+        if(value) notFull.notify();
+        return value;
+    }
+    void push_wait(T& value){
+        push_until(value,forever);
+    }
+    template <class Rep, class Period>
+    bool push_for(T& value, chrono::duration<Rep,Period> timeout){
+        return push_until(value,chrono::steady_clock::now()+timeout);
+    }
+    bool push_until(T& value, Deadline deadline){
+        if(!notFull.wait([&]{return Buffer::push(value);},deadline)) return false;
+        notEmpty.notify();
+        return true;
+    }
+    optional<T> pop_wait(){
+        return pop_until(forever);
+    }
+    template <class Rep, class Period>
+    optional<T> pop_for(chrono::duration<Rep,Period> timeout){
+        return pop_until(chrono::steady_clock::now()+timeout);
+    }
+    optional<T> pop_until(Deadline deadline){
+        optional<T> value;
+        if(!notEmpty.wait([&]{return bool(value=Buffer::pop());},deadline)) return {};
+        notFull.notify();
+        return value;
+    }
+    //the batch interface of RingBuffer, when present, notifies as well
+    size_t push_n(span<const T> values) requires requires(Buffer b){b.push_n(values);}{
+        size_t n=Buffer::push_n(values);
+        if(n) notEmpty.notify();
+        return n;
+    }
+    size_t pop_n(span<T> values) requires requires(Buffer b){b.pop_n(values);}{
+        size_t n=Buffer::pop_n(values);
+        if(n) notFull.notify();
+        return n;
+    }
+    void commitWrite(size_t n) requires requires(Buffer b){b.commitWrite(n);}{
+        Buffer::commitWrite(n);
+        notEmpty.notify();
     }
+    void commitRead(size_t n) requires requires(Buffer b){b.commitRead(n);}{
+        Buffer::commitRead(n);
+        notFull.notify();
+    }
+    private:
+    Wait notEmpty;
+    Wait notFull;
+};
+
+using DemoBuffer=BlockingRingBuffer<RingBuffer<int,BUFFSIZE>,CondVarWait>;
+
+void writeToBuffer(DemoBuffer& rb){
+    for(int i=0;i<STREAMSIZE;i++)
+        rb.push_wait(i);
 }
 
-void readFromBuffer(RingBuffer<int,BUFFSIZE>& rb){
-    optional<int>oi;
+void readFromBuffer(DemoBuffer& rb){
     for(int i=0;i<STREAMSIZE;i++){
         cout<<"distance from read to write iterators: "
             <<distance(rb.begin(),rb.end())
             <<endl;
-        if((oi=rb.pop())){
-            cout<<"expected: "
-                <<i
-                <<" read value: "
-                <<oi.value()
-                <<endl<<endl;
-        }else i--;
+        cout<<"expected: "
+            <<i
+            <<" read value: "
+            <<rb.pop_wait().value()
+            <<endl<<endl;
     }
 }
 
-int main() {
-    RingBuffer<int,BUFFSIZE>rb{};
-    thread t1(writeToBuffer, ref(rb));
-    thread t2(readFromBuffer, ref(rb));
-    t1.join();
-    t2.join();
-    return 0;
+template <size_t Bytes>
+struct Payload{
+    uint64_t seq=0;
+    char pad[Bytes-sizeof(uint64_t)]={};
+};
+template <>
+struct Payload<sizeof(uint64_t)>{
+    uint64_t seq=0;
+};
+
+//heap allocated, large rings would not fit on the stack
+template <class Buffer>
+struct Maker{
+    static unique_ptr<Buffer> make(size_t){return make_unique<Buffer>();}
+};
+template <class T>
+struct Maker<DynamicRingBuffer<T>>{
+    static unique_ptr<DynamicRingBuffer<T>> make(size_t capacity){
+        return make_unique<DynamicRingBuffer<T>>(capacity);
+    }
+};
+#ifndef _WIN32
+template <class T>
+struct Maker<ShmRingBuffer<T>>{
+    static unique_ptr<ShmRingBuffer<T>> make(size_t capacity){
+        string name="/ringbuffer-"+to_string(getpid());
+        auto ring=ShmRingBuffer<T>::create(name,capacity);
+        ShmRingBuffer<T>::unlink(name);//the mapping keeps the segment alive
+        if(!ring) return nullptr;
+        return make_unique<ShmRingBuffer<T>>(move(*ring));
+    }
+};
+#endif
+
+template <class Buffer, class T>
+void pushOne(Buffer& rb, T& value){
+    if constexpr(requires{rb.push_wait(value);}) rb.push_wait(value);
+    else while(!rb.push(value)) this_thread::yield();
+}
+
+//gives up after a millisecond so stress producers can notice a stalled run
+template <class Buffer, class T>
+bool tryPush(Buffer& rb, T& value){
+    if constexpr(requires{rb.push_for(value,chrono::milliseconds(1));})
+        return rb.push_for(value,chrono::milliseconds(1));
+    else{
+        bool pushed=rb.push(value);
+        if(!pushed) this_thread::yield();
+        return pushed;
+    }
 }
 
+template <class Buffer>
+auto popOne(Buffer& rb){
+    if constexpr(requires{rb.pop_for(chrono::milliseconds(1));})
+        return rb.pop_for(chrono::milliseconds(1));
+    else{
+        auto value=rb.pop();
+        if(!value) this_thread::yield();
+        return value;
+    }
+}
 
+void pinToCore(size_t core){
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core%max(1u,thread::hardware_concurrency()),&set);
+    pthread_setaffinity_np(pthread_self(),sizeof(set),&set);
+#else
+    (void)core;
+#endif
+}
 
+double seconds(chrono::steady_clock::time_point start){
+    return chrono::duration<double>(chrono::steady_clock::now()-start).count();
+}
 
+template <class Buffer>
+double throughput(Buffer& rb, size_t producers, size_t consumers, size_t items){
+    using T=typename decltype(rb.pop())::value_type;
+    size_t perProducer=items/producers;
+    items=perProducer*producers;
+    atomic<size_t> ready{0},consumed{0};
+    atomic<bool> go{false};
+    vector<thread> threads;
+    for(size_t p=0;p<producers;p++)
+        threads.emplace_back([&,p]{
+            pinToCore(p);
+            ready++;
+            while(!go.load(memory_order_acquire)) this_thread::yield();
+            T value{};
+            for(size_t i=0;i<perProducer;i++){
+                value.seq=i;
+                pushOne(rb,value);
+            }
+        });
+    for(size_t c=0;c<consumers;c++)
+        threads.emplace_back([&,c]{
+            pinToCore(producers+c);
+            ready++;
+            while(!go.load(memory_order_acquire)) this_thread::yield();
+            while(consumed.load(memory_order_relaxed)<items)
+                if(popOne(rb)) consumed.fetch_add(1,memory_order_relaxed);
+        });
+    while(ready.load()<producers+consumers) this_thread::yield();
+    auto start=chrono::steady_clock::now();
+    go.store(true,memory_order_release);
+    for(auto& t:threads) t.join();
+    return items/seconds(start);
+}
 
+template <class Buffer>
+void throughputRow(const char* name, size_t capacity, size_t items, bool multi){
+    using T=typename decltype(declval<Buffer&>().pop())::value_type;
+    cout<<capacity<<"\t"<<sizeof(T)<<"\t"<<name;
+    for(auto [p,c]:{pair<size_t,size_t>{1,1},{4,1},{4,4}}){
+        if(p>1&&!multi){
+            cout<<"\t\t-";
+            continue;
+        }
+        auto rb=Maker<Buffer>::make(capacity);
+        cout<<"\t\t"<<(rb?size_t(throughput(*rb,p,c,items)):0);
+    }
+    cout<<endl;
+}
 
+template <size_t Capacity, size_t Bytes>
+void throughputRows(size_t items){
+    using T=Payload<Bytes>;
+    throughputRow<RingBuffer<T,Capacity>>("mutex  ",Capacity,items,true);
+    throughputRow<MPMCRingBuffer<T,Capacity>>("mpmc   ",Capacity,items,true);
+    throughputRow<DynamicRingBuffer<T>>("dynamic",Capacity,items,false);
+#ifndef _WIN32
+    throughputRow<ShmRingBuffer<T>>("shm    ",Capacity,items,false);
+#endif
+}
 
+template <size_t Capacity>
+void throughputRows(size_t items){
+    throughputRows<Capacity,8>(items);
+    throughputRows<Capacity,64>(items);
+    throughputRows<Capacity,256>(items);
+}
 
+//latency buckets are powers of two: bucket b holds values below 2^b ns
+struct Histogram{
+    array<uint64_t,65> buckets{};
+    uint64_t count=0;
+    uint64_t longest=0;
+    void add(uint64_t ns){
+        buckets[bit_width(ns)]++;
+        count++;
+        longest=max(longest,ns);
+    }
+    uint64_t percentile(double p)const{
+        uint64_t rank=uint64_t(p*double(count)),seen=0;
+        for(size_t b=0;b<buckets.size();b++)
+            if((seen+=buckets[b])>rank) return b<64?min(uint64_t(1)<<b,longest):longest;
+        return longest;
+    }
+    void print()const{
+        for(size_t b=0;b<buckets.size();b++){
+            if(!buckets[b]) continue;
+            cout<<"    < "<<(uint64_t(1)<<b)<<" ns\t"<<buckets[b]<<"\t"
+                <<string(size_t(60.0*double(buckets[b])/double(count)),'#')<<endl;
+        }
+    }
+};
+
+template <class Buffer>
+Histogram roundTrip(size_t rounds){
+    using T=typename decltype(declval<Buffer&>().pop())::value_type;
+    auto there=Maker<Buffer>::make(1024);
+    auto back=Maker<Buffer>::make(1024);
+    Histogram h;
+    if(!there||!back) return h;
+    thread echo([&]{
+        pinToCore(1);
+        for(size_t i=0;i<rounds;i++){
+            optional<T> value;
+            while(!(value=popOne(*there)));
+            pushOne(*back,*value);
+        }
+    });
+    thread ping([&]{
+        pinToCore(0);
+        T value{};
+        for(size_t i=0;i<rounds;i++){
+            value.seq=i;
+            auto start=chrono::steady_clock::now();
+            pushOne(*there,value);
+            while(!popOne(*back));
+            h.add(uint64_t(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now()-start).count()));
+        }
+    });
+    ping.join();
+    echo.join();
+    return h;
+}
+
+template <class Buffer>
+void latencyRow(const char* name, size_t rounds){
+    Histogram h=roundTrip<Buffer>(rounds);
+    cout<<name<<"\t"<<h.percentile(0.5)<<"\t"<<h.percentile(0.99)<<"\t"
+        <<h.percentile(0.999)<<"\t"<<h.longest<<endl;
+    h.print();
+}
+
+template <class Ring>
+double broadcastThroughput(size_t readers, size_t items){
+    Ring ring{};
+    vector<typename Ring::Reader> subscribers;
+    for(size_t r=0;r<readers;r++) subscribers.push_back(*ring.subscribe());
+    vector<thread> threads;
+    auto start=chrono::steady_clock::now();
+    for(size_t r=0;r<readers;r++)
+        threads.emplace_back([&,r]{
+            pinToCore(r+1);
+            for(size_t i=0;i<items;){
+                if(subscribers[r].pop()) i++;
+                else this_thread::yield();
+            }
+        });
+    threads.emplace_back([&]{
+        pinToCore(0);
+        for(size_t i=0;i<items;i++)
+            while(!ring.push(int(i))) this_thread::yield();
+    });
+    for(auto& t:threads) t.join();
+    return items/seconds(start);
+}
+
+double fanOutThroughput(size_t readers, size_t items){
+    vector<RingBuffer<int,1024>> rings(readers);
+    vector<thread> threads;
+    auto start=chrono::steady_clock::now();
+    for(size_t r=0;r<readers;r++)
+        threads.emplace_back([&,r]{
+            pinToCore(r+1);
+            for(size_t i=0;i<items;){
+                if(rings[r].pop()) i++;
+                else this_thread::yield();
+            }
+        });
+    threads.emplace_back([&]{
+        pinToCore(0);
+        for(size_t i=0;i<items;i++)
+            for(auto& rb:rings){
+                int v=int(i);
+                while(!rb.push(v)) this_thread::yield();
+            }
+    });
+    for(auto& t:threads) t.join();
+    return items/seconds(start);
+}
 
+#ifndef _WIN32
+//producer and consumer in two processes sharing one ShmRingBuffer
+double shmThroughput(size_t items){
+    string name="/ringbuffer-bench-"+to_string(getpid());
+    auto ring=ShmRingBuffer<Payload<8>>::create(name,1024);
+    if(!ring) return 0;
+    auto start=chrono::steady_clock::now();
+    pid_t child=fork();
+    if(child==0){
+        pinToCore(0);
+        auto producer=ShmRingBuffer<Payload<8>>::open(name);
+        for(uint64_t i=0;producer&&i<items;){
+            auto r=producer->claimWrite(min<uint64_t>(64,items-i));
+            for(auto& x:r.first) x.seq=i++;
+            for(auto& x:r.second) x.seq=i++;
+            if(r.size()) producer->commitWrite(r.size());
+            else this_thread::yield();
+        }
+        _exit(0);
+    }
+    bool ordered=true,exited=false;
+    uint64_t i=0;
+    thread consumer([&]{
+        pinToCore(1);
+        for(uint64_t misses=0;i<items;){
+            if(auto v=ring->pop()){
+                ordered&=v->seq==i++;
+                continue;
+            }
+            if(exited) break;//drained once more after the child exited
+            if(++misses%1024==0) exited=waitpid(child,nullptr,WNOHANG)==child;
+            else this_thread::yield();
+        }
+    });
+    consumer.join();
+    if(!exited) waitpid(child,nullptr,0);
+    ShmRingBuffer<Payload<8>>::unlink(name);//the segment lives on while mapped
+    return ordered&&i==items?items/seconds(start):0;
+}
+#endif
+
+double batchThroughput(size_t batch, size_t items){
+    auto rb=make_unique<RingBuffer<int,1024>>();
+    thread producer([&]{
+        pinToCore(0);
+        vector<int> values(batch);
+        for(size_t i=0;i<items;){
+            size_t n=rb->push_n(span<const int>(values.data(),min(batch,items-i)));
+            if(n) i+=n;
+            else this_thread::yield();
+        }
+    });
+    auto start=chrono::steady_clock::now();
+    thread consumer([&]{
+        pinToCore(1);
+        vector<int> values(batch);
+        for(size_t i=0;i<items;){
+            size_t n=rb->pop_n(values);
+            if(n) i+=n;
+            else this_thread::yield();
+        }
+    });
+    producer.join();
+    consumer.join();
+    return items/seconds(start);
+}
+
+void benchmark(size_t items){
+    cout<<"throughput in ops/s, producers x consumers"<<endl;
+    cout<<"slots\tbytes\tbuffer\t\t1x1 SPSC\t4x1 MPSC\t4x4 MPMC"<<endl;
+    throughputRows<64>(items);
+    throughputRows<1024>(items);
+    throughputRows<16384>(items);
+#ifndef _WIN32
+    cout<<endl<<"shm across two processes, 1024 slots, 8 bytes: "<<size_t(shmThroughput(items))<<" ops/s"<<endl;
+#endif
+
+    cout<<endl<<"threads/side\tmutex ops/s\tmpmc ops/s, 1024 slots, 8 bytes"<<endl;
+    for(size_t n=1;n<=32;n*=2){
+        auto m=Maker<RingBuffer<Payload<8>,1024>>::make(1024);
+        auto l=Maker<MPMCRingBuffer<Payload<8>,1024>>::make(1024);
+        cout<<n<<"\t\t"<<size_t(throughput(*m,n,n,items))<<"\t\t"<<size_t(throughput(*l,n,n,items))<<endl;
+    }
+    DynamicRingBuffer<unique_ptr<string>> owners(4);
+    owners.emplace(make_unique<string>("move only elements"));
+    cout<<endl<<"dynamic: "<<**owners.pop()<<" are supported"<<endl;
+
+    cout<<endl<<"wait strategies, 1024 slots, 8 bytes"<<endl;
+    cout<<"slots\tbytes\tbuffer\t\t1x1 SPSC\t4x1 MPSC\t4x4 MPMC"<<endl;
+    using T=Payload<8>;
+    throughputRow<BlockingRingBuffer<MPMCRingBuffer<T,1024>,SpinWait>>("spin   ",1024,items,true);
+    throughputRow<BlockingRingBuffer<MPMCRingBuffer<T,1024>,SpinYieldWait>>("yield  ",1024,items,true);
+    throughputRow<BlockingRingBuffer<MPMCRingBuffer<T,1024>,FutexWait>>("futex  ",1024,items,true);
+    throughputRow<BlockingRingBuffer<MPMCRingBuffer<T,1024>,CondVarWait>>("condvar",1024,items,true);
+
+    cout<<endl<<"round trip latency in ns, 1024 slots, 8 bytes"<<endl;
+    cout<<"buffer\tp50\tp99\tp99.9\tmax"<<endl;
+    size_t rounds=max(items/16,size_t(1000));
+    latencyRow<RingBuffer<T,1024>>("mutex",rounds);
+    latencyRow<MPMCRingBuffer<T,1024>>("mpmc",rounds);
+    latencyRow<DynamicRingBuffer<T>>("dynamic",rounds);
+#ifndef _WIN32
+    latencyRow<ShmRingBuffer<T>>("shm",rounds);
+#endif
+    latencyRow<BlockingRingBuffer<MPMCRingBuffer<T,1024>,FutexWait>>("futex",rounds);
+
+    cout<<endl<<"batch size\tmutex ops/s (push_n/pop_n, 1x1)"<<endl;
+    for(size_t batch=1;batch<=256;batch*=4)
+        cout<<batch<<"\t\t"<<size_t(batchThroughput(batch,items))<<endl;
+
+    cout<<endl<<"readers\t\tbuffer per reader\tbroadcast ops/s"<<endl;
+    for(size_t n=1;n<=8;n*=2)
+        cout<<n<<"\t\t"<<size_t(fanOutThroughput(n,items/4))<<"\t\t\t"
+            <<size_t(broadcastThroughput<BroadcastRingBuffer<int,1024>>(n,items/4))<<endl;
+}
+
+bool report(const string& name, bool ok, const string& detail=""){
+    cout<<(ok?"ok      ":"FAILED  ")<<name<<" "<<detail<<endl;
+    return ok;
+}
+
+string lost(uint64_t got, uint64_t items){
+    return "lost "+to_string(items-got)+" of "+to_string(items)+" items";
+}
+
+//a consumer calls idle() each time it finds nothing; true once progress has
+//not moved for a few seconds, so a lost item fails the run instead of hanging it
+class StallTimer{
+    public:
+    bool idle(uint64_t progress){
+        auto now=chrono::steady_clock::now();
+        if(progress!=seen){
+            seen=progress;
+            until=now+chrono::seconds(5);
+        }
+        return now>=until;
+    }
+    private:
+    uint64_t seen=UINT64_MAX;
+    Deadline until;
+};
+
+//every producer tags its items; consumers check per producer order, totals and sums
+template <class Buffer>
+bool stressQueue(const string& name, size_t producers, size_t consumers, size_t items){
+    using T=typename decltype(declval<Buffer&>().pop())::value_type;
+    auto rb=Maker<Buffer>::make(64);
+    if(!rb) return report(name,false,"could not create buffer");
+    size_t perProducer=items/producers;
+    items=perProducer*producers;
+    vector<atomic<uint64_t>> received(producers),sums(producers);
+    atomic<size_t> consumed{0};
+    atomic<bool> ordered{true},stalled{false};
+    vector<thread> threads;
+    for(size_t p=0;p<producers;p++)
+        threads.emplace_back([&,p]{
+            T value{};
+            for(uint64_t i=0;i<perProducer;i++){
+                value.seq=(uint64_t(p)<<40)|i;
+                while(!tryPush(*rb,value))
+                    if(stalled.load(memory_order_relaxed)) return;
+            }
+        });
+    for(size_t c=0;c<consumers;c++)
+        threads.emplace_back([&]{
+            vector<int64_t> last(producers,-1);
+            StallTimer stall;
+            while(consumed.load(memory_order_relaxed)<items&&!stalled.load(memory_order_relaxed)){
+                auto value=popOne(*rb);
+                if(!value){
+                    if(stall.idle(consumed.load(memory_order_relaxed))) stalled=true;
+                    continue;
+                }
+                size_t p=size_t(value->seq>>40);
+                int64_t i=int64_t(value->seq&((uint64_t(1)<<40)-1));
+                if(p>=producers||i<=last[p]){
+                    ordered=false;
+                    consumed++;
+                    continue;
+                }
+                last[p]=i;
+                received[p]++;
+                sums[p]+=uint64_t(i);
+                consumed++;
+            }
+        });
+    for(auto& t:threads) t.join();
+    string label=name+" "+to_string(producers)+"x"+to_string(consumers);
+    if(stalled) return report(label,false,lost(consumed,items));
+    bool complete=!rb->pop();
+    for(size_t p=0;p<producers;p++)
+        complete&=received[p]==perProducer&&sums[p]==perProducer*(perProducer-1)/2;
+    return report(label,ordered&&complete,
+                  ordered?(complete?"":"lost or duplicated items"):"out of order");
+}
+
+template <class Buffer>
+bool stressAll(const string& name, size_t items){
+    bool ok=stressQueue<Buffer>(name,1,1,items);
+    ok&=stressQueue<Buffer>(name,4,1,items);
+    return stressQueue<Buffer>(name,4,4,items)&&ok;
+}
+
+template <class Wait>
+bool stressWait(const string& name, size_t items){
+    using T=Payload<8>;
+    bool ok=stressAll<BlockingRingBuffer<RingBuffer<T,64>,Wait>>("blocking mutex "+name,items);
+    return stressAll<BlockingRingBuffer<MPMCRingBuffer<T,64>,Wait>>("blocking mpmc "+name,items)&&ok;
+}
+
+bool stressBatch(size_t items){
+    auto rb=make_unique<RingBuffer<uint64_t,64>>();
+    atomic<bool> stalled{false};
+    thread producer([&]{
+        for(uint64_t next=0;next<items&&!stalled.load(memory_order_relaxed);){
+            if(next%2){
+                auto r=rb->claimWrite(min<uint64_t>(7,items-next));
+                for(auto& x:r.first) x=next++;
+                for(auto& x:r.second) x=next++;
+                if(r.size()) rb->commitWrite(r.size());
+                else this_thread::yield();
+            }else{
+                uint64_t values[5];
+                size_t n=min<uint64_t>(5,items-next);
+                for(size_t i=0;i<n;i++) values[i]=next+i;
+                n=rb->push_n(span<const uint64_t>(values,n));
+                if(n) next+=n;
+                else this_thread::yield();
+            }
+        }
+    });
+    bool ordered=true;
+    StallTimer stall;
+    uint64_t expect=0;
+    while(expect<items){
+        uint64_t values[9];
+        size_t n=rb->pop_n(values);
+        for(size_t i=0;i<n;i++) ordered&=values[i]==expect++;
+        auto r=rb->claimRead(3);
+        for(auto x:r.first) ordered&=x==expect++;
+        for(auto x:r.second) ordered&=x==expect++;
+        rb->commitRead(r.size());
+        if(n||r.size()) continue;
+        if(stall.idle(expect)) break;
+        this_thread::yield();
+    }
+    stalled=expect<items;
+    producer.join();
+    if(stalled) return report("mutex batch and claim 1x1",false,lost(expect,items));
+    return report("mutex batch and claim 1x1",ordered&&!rb->pop());
+}
+
+#ifndef _WIN32
+//claims without a count take every free or filled slot, so they wrap the ring each time
+bool stressShmClaim(size_t items){
+    auto rb=Maker<ShmRingBuffer<uint64_t>>::make(64);
+    if(!rb) return report("shm claim all 1x1",false,"could not create buffer");
+    bool refills=true;
+    for(int round=0;round<3;round++){
+        auto r=rb->claimWrite();
+        refills&=r.size()==rb->capacity();
+        rb->commitWrite(r.size());
+        rb->commitRead(rb->claimRead().size());
+    }
+    if(!refills) return report("shm claim all 1x1",false,"full claim never saw the ring drain");
+    //a moved ring must keep its cached indices, or it hands out slots in use
+    rb->commitWrite(rb->claimWrite(rb->capacity()-4).size());
+    auto moved=make_unique<ShmRingBuffer<uint64_t>>(move(*rb));
+    bool kept=moved->claimWrite(10).size()==4;
+    moved->commitRead(moved->claimRead().size());
+    kept&=moved->claimRead(5).size()==0;
+    if(!kept) return report("shm claim all 1x1",false,"move lost the cached indices");
+    rb=move(moved);
+    atomic<bool> stalled{false};
+    thread producer([&]{
+        for(uint64_t next=0;next<items&&!stalled.load(memory_order_relaxed);){
+            auto r=rb->claimWrite();
+            size_t n=min<uint64_t>(r.size(),items-next);
+            for(size_t i=0;i<n;i++) (i<r.first.size()?r.first[i]:r.second[i-r.first.size()])=next++;
+            if(n) rb->commitWrite(n);
+            else this_thread::yield();
+        }
+    });
+    bool ordered=true;
+    StallTimer stall;
+    uint64_t expect=0;
+    while(expect<items){
+        auto r=rb->claimRead();
+        for(auto x:r.first) ordered&=x==expect++;
+        for(auto x:r.second) ordered&=x==expect++;
+        if(r.size()) rb->commitRead(r.size());
+        else if(stall.idle(expect)) break;
+        else this_thread::yield();
+    }
+    stalled=expect<items;
+    producer.join();
+    if(stalled) return report("shm claim all 1x1",false,lost(expect,items));
+    return report("shm claim all 1x1",ordered&&!rb->pop());
+}
+
+//the producer is a child process that maps the segment again by name, so the
+//ring is used from two address spaces at once
+bool stressShmProcesses(size_t items){
+    string name="/ringbuffer-stress-"+to_string(getpid());
+    auto ring=ShmRingBuffer<uint64_t>::create(name,64);
+    if(!ring) return report("shm processes 1x1",false,"could not create buffer");
+    pid_t child=fork();
+    if(child<0){
+        ShmRingBuffer<uint64_t>::unlink(name);
+        return report("shm processes 1x1",false,"fork failed");
+    }
+    if(child==0){
+        auto producer=ShmRingBuffer<uint64_t>::open(name);
+        if(!producer) _exit(1);
+        for(uint64_t i=0;i<items;){
+            if(producer->push(i)) i++;
+            else this_thread::yield();
+        }
+        _exit(0);
+    }
+    bool ordered=true,exited=false;
+    int status=0;
+    uint64_t got=0,misses=0;
+    StallTimer stall;
+    while(got<items){
+        if(auto value=ring->pop()){
+            ordered&=*value==got++;
+            continue;
+        }
+        //one more pass after the child exits drains what it wrote last
+        if(exited||stall.idle(got)) break;
+        if(++misses%1024==0) exited=waitpid(child,&status,WNOHANG)==child;
+        this_thread::yield();
+    }
+    if(!exited){
+        if(got<items) kill(child,SIGKILL);
+        waitpid(child,&status,0);
+    }
+    ShmRingBuffer<uint64_t>::unlink(name);
+    if(got<items){
+        bool failed=exited&&!(WIFEXITED(status)&&WEXITSTATUS(status)==0);
+        return report("shm processes 1x1",false,failed?"producer process failed":lost(got,items));
+    }
+    return report("shm processes 1x1",ordered&&!ring->pop(),ordered?"":"out of order");
+}
+#endif
+
+template <Overrun Mode>
+bool stressBroadcast(const string& name, size_t readers, size_t items){
+    BroadcastRingBuffer<uint64_t,64,Mode> ring;
+    vector<typename BroadcastRingBuffer<uint64_t,64,Mode>::Reader> subscribers;
+    for(size_t r=0;r<readers;r++) subscribers.push_back(*ring.subscribe());
+    atomic<bool> ok{true},stalled{false};
+    atomic<uint64_t> missing{0};
+    vector<thread> threads;
+    for(auto& sub:subscribers)
+        threads.emplace_back([&]{
+            int64_t last=-1;
+            uint64_t got=0;
+            StallTimer stall;
+            while(last+1<int64_t(items)){
+                auto value=sub.pop();
+                if(!value){
+                    if(stall.idle(uint64_t(last+1))){
+                        stalled=true;
+                        missing+=items-uint64_t(last+1);
+                        return;
+                    }
+                    this_thread::yield();
+                    continue;
+                }
+                if(int64_t(*value)<=last||(Mode==Overrun::gate&&int64_t(*value)!=last+1)) ok=false;
+                last=int64_t(*value);
+                got++;
+            }
+            if(got+sub.lost()!=items) ok=false;
+        });
+    for(uint64_t i=0;i<items&&!stalled;i++)
+        while(!ring.push(i)&&!stalled) this_thread::yield();
+    for(auto& t:threads) t.join();
+    if(stalled) return report(name+" 1x"+to_string(readers),false,lost(items*readers-missing,items*readers));
+    return report(name+" 1x"+to_string(readers),ok);
+}
+
+bool stress(size_t items){
+    using T=Payload<8>;
+    bool ok=stressAll<RingBuffer<T,64>>("mutex",items);
+    ok&=stressAll<MPMCRingBuffer<T,64>>("mpmc",items);
+    ok&=stressQueue<DynamicRingBuffer<T>>("dynamic",1,1,items);
+#ifndef _WIN32
+    ok&=stressQueue<ShmRingBuffer<T>>("shm threads",1,1,items);
+    ok&=stressShmClaim(items);
+    ok&=stressShmProcesses(items);
+#endif
+    ok&=stressBatch(items);
+    ok&=stressWait<SpinWait>("spin",items);
+    ok&=stressWait<SpinYieldWait>("yield",items);
+    ok&=stressWait<FutexWait>("futex",items);
+    ok&=stressWait<CondVarWait>("condvar",items);
+    ok&=stressBroadcast<Overrun::gate>("broadcast gate",4,items);
+    ok&=stressBroadcast<Overrun::lap>("broadcast lap",4,items);
+    cout<<(ok?"all passed":"some variants FAILED")<<endl;
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    string mode=argc>1?argv[1]:"";
+    size_t items=argc>2?stoul(argv[2]):size_t(1)<<17;
+    if(mode=="bench"){
+        benchmark(items);
+        return 0;
+    }
+    if(mode=="stress") return stress(items)?0:1;
+    DemoBuffer rb{};
+    thread t1(writeToBuffer, ref(rb));
+    thread t2(readFromBuffer, ref(rb));
+    t1.join();
+    t2.join();
+    return 0;
+}